@@ -0,0 +1,201 @@
+// Trigger emulation campaign split over worker processes.
+//
+// usage: batch_run <job dir> <events per point> [workers] [events per shard] [GeV ...]
+//
+// Every energy point is cut into shards of events; each shard showers
+// random impact points and counts which logic patterns pass their
+// threshold. Shard results are checkpoints in the job directory, so
+// rerunning the same command after a crash or a kill only does the
+// missing shards. The job directory also holds manifest.txt with the
+// energies, event counts and tables of the job; a rerun with other
+// arguments is refused instead of mixing in the old shards. The merge
+// reads the shards in order, checks each against its energy point and
+// event count, and writes
+// <job dir>/result.txt, which depends only on the arguments, not on the
+// number of workers or on which shards were retried.
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#include <thread>
+
+#include "include/Layout.hh"
+#include "include/LogicTable.hh"
+#include "include/LogicParams.hh"
+#include "include/ShowerGenerator.hh"
+#include "include/ShardRunner.hh"
+
+using namespace std;
+
+// Trigger tables as packed into the shared segment
+struct TriggerTables {
+  int ngroups, nentries;
+  const int* groupstart;
+  const int* modules;
+  const float* cut;
+};
+
+TriggerTables pack(SharedSegment& segment, const LogicTable& logic, const LogicParams& params) {
+  int ngroups = logic.groups();
+  int nentries = logic.entries();
+  segment.allocate( sizeof(int) * ( 2 + ngroups+1 + nentries ) + sizeof(float) * ngroups );
+  int* header = (int*) segment.data();
+  int* groupstart = header + 2;
+  int* modules = groupstart + ngroups+1;
+  float* cut = (float*)( modules + nentries );
+  header[0] = ngroups;
+  header[1] = nentries;
+  for( int g=0; g<ngroups; g++ ) {
+    int n;
+    const int* mods = logic.groupmodules( g, n );
+    groupstart[g] = logic.first(g);
+    memcpy( modules + logic.first(g), mods, n*sizeof(int) );
+    cut[g] = params.cut(g);
+  }
+  groupstart[ngroups] = nentries;
+  segment.seal();
+
+  TriggerTables tables = { ngroups, nentries, groupstart, modules, cut };
+  return tables;
+}
+
+int main(int argc, char** argv) {
+  if( argc < 3 ) {
+    cerr << "usage: batch_run <job dir> <events per point> [workers] [events per shard] [GeV ...]" << endl;
+    return 1;
+  }
+  string dir = argv[1];
+  long nevents = atol(argv[2]);
+  int nworkers = (argc > 3) ? atoi(argv[3]) : thread::hardware_concurrency();
+  long shardevents = (argc > 4) ? atol(argv[4]) : 10000;
+  vector<float> energies;
+  for( int i=5; i<argc; i++ ) energies.push_back( atof(argv[i]) );
+  if( energies.empty() ) energies.push_back( 3.0 );
+  if( shardevents < 1 ) shardevents = 1;
+  string layoutfile = "ecal_layout.txt";
+  string logicfile = "full_logic_sept25.txt";
+  string paramfile = "param_dontdelete.txt";
+
+  // Geometry is read once here, the workers inherit it
+  Layout layout;
+  LogicTable logic;
+  LogicParams params;
+  if( !layout.read( layoutfile ) ) return 1;
+  if( !logic.read( logicfile ) || !logic.bind( layout ) ) return 1;
+  if( !params.read( paramfile, logic.groups() ) ) return 1;
+  SharedSegment segment;
+  TriggerTables tables = pack( segment, logic, params );
+
+  long pointshards = ( nevents + shardevents - 1 ) / shardevents;
+  int nshards = pointshards * energies.size();
+  ShardRunner runner( dir, nshards, nworkers );
+  ostringstream job;
+  job << "events " << nevents << "\n" << "shard " << shardevents << "\n" << "GeV";
+  for( int p=0; p<int(energies.size()); p++ ) job << " " << energies[p];
+  job << "\n" << "layout " << layoutfile << "\n" << "logic " << logicfile << "\n"
+      << "params " << paramfile << "\n" << "groups " << tables.ngroups << "\n";
+  if( !runner.manifest( job.str() ) ) return 1;
+  cerr << nshards << " shards, " << runner.remaining() << " to run on " << nworkers << " workers" << endl;
+
+  // The shower tables are built once here, every forked worker
+  // inherits them and only reseeds
+  ShowerGenerator generator( layout );
+
+  bool ok = runner.run( [&](int shard, FILE* out) {
+      int point = shard / pointshards;
+      long first = ( shard % pointshards ) * shardevents;
+      long count = ( first + shardevents < nevents ) ? shardevents : nevents - first;
+      float energy = 1000 * energies[point];
+
+      // One random stream per shard keeps the result independent of scheduling
+      generator.reseed( 12345 + point, shard % pointshards );
+      vector<float> deposit( layout.size() );
+      vector<long> fired( tables.ngroups, 0 );
+      long triggered = 0;
+      for( long ev=0; ev<count; ev++ ) {
+	float x, y;
+	generator.randompoint( x, y );
+	fill( deposit.begin(), deposit.end(), 0.0f );
+	generator.shower( x, y, energy, &deposit[0], 0 );
+	bool any = false;
+	for( int g=0; g<tables.ngroups; g++ ) {
+	  float sum = 0;
+	  for( int k=tables.groupstart[g]; k<tables.groupstart[g+1]; k++ ) {
+	    int mod = tables.modules[k];
+	    if( mod >= 0 ) sum += deposit[mod];
+	  }
+	  if( sum > tables.cut[g] ) {
+	    fired[g]++;
+	    any = true;
+	  }
+	}
+	if( any ) triggered++;
+      }
+
+      fprintf( out, "%g %ld %ld\n", energies[point], count, triggered );
+      for( int g=0; g<tables.ngroups; g++ ) fprintf( out, "%d %ld\n", g, fired[g] );
+      return true;
+    } );
+  if( !ok ) {
+    cerr << runner.remaining() << " shards unfinished, rerun to resume" << endl;
+    return 1;
+  }
+
+  // Merge in shard order
+  int npoints = energies.size();
+  vector<long> events( npoints, 0 ), triggered( npoints, 0 );
+  vector<long> fired( long(npoints) * tables.ngroups, 0 );
+  for( int shard=0; shard<nshards; shard++ ) {
+    int point = shard / pointshards;
+    long first = ( shard % pointshards ) * shardevents;
+    long expected = ( first + shardevents < nevents ) ? shardevents : nevents - first;
+    ifstream in( runner.shardfile( shard ).c_str() );
+    float gev;
+    long count, trig;
+    if( !( in >> gev >> count >> trig ) ) {
+      cerr << "Error reading " << runner.shardfile( shard ) << endl;
+      return 1;
+    }
+    // The shard must belong to this job, %g keeps six digits of the energy
+    if( fabs( gev - energies[point] ) > 1e-5 * fabs( energies[point] ) || count != expected ) {
+      cerr << "Error: " << runner.shardfile( shard ) << " has " << gev << " GeV, " << count
+	   << " events, expected " << energies[point] << " GeV, " << expected << " events" << endl;
+      return 1;
+    }
+    events[point] += count;
+    triggered[point] += trig;
+    int g;
+    long n;
+    while( in >> g >> n ) {
+      if( g < 0 || g >= tables.ngroups ) {
+	cerr << "Error: " << runner.shardfile( shard ) << " has unknown pattern " << g << endl;
+	return 1;
+      }
+      fired[ long(point) * tables.ngroups + g ] += n;
+    }
+  }
+
+  string result = dir + "/result.txt";
+  FILE* out = fopen( ( result + ".part" ).c_str(), "w" );
+  if( !out ) {
+    cerr << "Error opening " << result << endl;
+    return 1;
+  }
+  for( int p=0; p<npoints; p++ ) {
+    fprintf( out, "# %g GeV, %ld events, %ld triggered (%.4f)\n", energies[p], events[p],
+	     triggered[p], events[p] ? double(triggered[p]) / events[p] : 0.0 );
+    for( int g=0; g<tables.ngroups; g++ ) {
+      long n = fired[ long(p) * tables.ngroups + g ];
+      fprintf( out, "%g %d %ld %.6f\n", energies[p], g+1, n, events[p] ? double(n) / events[p] : 0.0 );
+    }
+  }
+  fclose( out );
+  rename( ( result + ".part" ).c_str(), result.c_str() );
+  cout << "Wrote " << result << endl;
+  return 0;
+}
@@ -0,0 +1,136 @@
+// Benchmark of the logic group kernels used by ECal::triggerlogic().
+//
+// usage: bench_logic [layout file] [repetitions]
+//
+// Nodes are laid out on the 80 x 160 mm grid of ECal::initializeECal()
+// and kept if they fall on a module. Every kernel builds a group for
+// every node; the time per node is reported for the nearest cell search
+// and the neighbour growth separately. The full LogicBuilder pass is then
+// repeated over the same nodes and the heap allocations per pass are
+// counted through the operator new below, plus the arena's own blocks.
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <atomic>
+#include <new>
+
+#include "include/Layout.hh"
+#include "include/LogicKernel.hh"
+#include "include/LogicBuilder.hh"
+
+using namespace std;
+
+// Every new and new[] in this program goes through here
+atomic<long> allocations( 0 );
+
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc( size ? size : 1 );
+  if( !p ) throw bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free( p );
+}
+
+double seconds(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+}
+
+template <class Kernel>
+void bench(const char* name, const vector<float>& x, const vector<float>& y,
+	   const vector<float>& nodex, const vector<float>& nodey, int repetitions) {
+  int ncells = x.size();
+  int nnodes = nodex.size();
+  vector<int> seeds( nnodes );
+  int group[ Kernel::maxcells ];
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for( int r=0; r<repetitions; r++ ) {
+    for( int i=0; i<nnodes; i++ ) {
+      seeds[i] = Kernel::nearest( &x[0], &y[0], ncells, nodex[i], nodey[i] );
+    }
+  }
+  double tnearest = seconds( start );
+
+  long cells = 0;
+  start = chrono::steady_clock::now();
+  for( int r=0; r<repetitions; r++ ) {
+    for( int i=0; i<nnodes; i++ ) {
+      cells += Kernel::grow( &x[0], &y[0], ncells, seeds[i], nodex[i], nodey[i], 42, group );
+    }
+  }
+  double tgrow = seconds( start );
+
+  double calls = double(repetitions) * nnodes;
+  cout << setw(10) << name << fixed << setprecision(3)
+       << setw(14) << 1e6*tnearest/calls << setw(14) << 1e6*tgrow/calls
+       << setw(12) << cells/calls << endl;
+}
+
+int main(int argc, char** argv) {
+  string layoutfile = (argc > 1) ? argv[1] : "ecal_layout.txt";
+  int repetitions = (argc > 2) ? atoi(argv[2]) : 20;
+
+  Layout layout;
+  if( !layout.read( layoutfile ) ) return 1;
+
+  vector<float> x, y;
+  float minx = 0, maxx = 0, miny = 0, maxy = 0;
+  for( int i=0; i<layout.size(); i++ ) {
+    const Module& mod = layout.module(i);
+    x.push_back( mod.x );
+    y.push_back( mod.y );
+    minx = (mod.x < minx) ? mod.x : minx;
+    maxx = (mod.x > maxx) ? mod.x : maxx;
+    miny = (mod.y < miny) ? mod.y : miny;
+    maxy = (mod.y > maxy) ? mod.y : maxy;
+  }
+
+  vector<float> nodex, nodey;
+  for( float ny = miny + 80; ny < maxy; ny += 160 ) {
+    for( float nx = minx + 80; nx < maxx; nx += 80 ) {
+      for( int i=0; i<layout.size(); i++ ) {
+	float half = 0.5 * layout.module(i).type;
+	if( fabs( nx - x[i] ) < half && fabs( ny - y[i] ) < half ) {
+	  nodex.push_back( nx );
+	  nodey.push_back( ny );
+	  break;
+	}
+      }
+    }
+  }
+
+  cout << "# " << layout.size() << " modules, " << nodex.size() << " nodes, "
+       << repetitions << " repetitions" << endl;
+  cout << setw(10) << "#kernel" << setw(14) << "nearest(us)" << setw(14) << "grow(us)"
+       << setw(12) << "cells" << endl;
+  bench<LogicKernel32>( "32", x, y, nodex, nodey, repetitions );
+  bench<LogicKernel64>( "64", x, y, nodex, nodey, repetitions );
+
+  // Whole builder passes, the first one warms up the arena and the store
+  vector<int> cells;
+  for( int i=0; i<layout.size(); i++ ) cells.push_back( layout.module(i).cell );
+  LogicBuilder builder;
+  builder.setmodules( &cells[0], &x[0], &y[0], cells.size() );
+  builder.build( &nodex[0], &nodey[0], nodex.size(), 32, 42 );
+
+  long before = allocations;
+  long blocks = builder.scratch().blocks();
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for( int r=0; r<repetitions; r++ ) {
+    builder.build( &nodex[0], &nodey[0], nodex.size(), 32, 42 );
+  }
+  double tbuild = seconds( start );
+  long heap = ( allocations - before ) + ( builder.scratch().blocks() - blocks );
+  cout << "# builder: " << builder.groups() << " groups, "
+       << 1e6*tbuild/( double(repetitions) * nodex.size() ) << " us per node, "
+       << double(heap) / repetitions << " heap allocations per pass after warm-up, "
+       << builder.scratch().peak() << " bytes of scratch" << endl;
+  return 0;
+}
@@ -0,0 +1,85 @@
+// Offline clustering of an event file in batches, one finder per thread.
+//
+// usage: cluster_batch <events|-> [threads] [batch events] [seed MeV] [cell MeV]
+//
+// Events are in the EventFile text format, e.g. written by shower_gen.
+// Each batch is expanded to dense module energies and handed to
+// ClusterBatch. Prints the cluster statistics and the clustering rate,
+// which excludes reading the file.
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include "include/Layout.hh"
+#include "include/EventFile.hh"
+#include "include/ClusterFinder.hh"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  if( argc < 2 ) {
+    cerr << "usage: cluster_batch <events|-> [threads] [batch events] [seed MeV] [cell MeV]" << endl;
+    return 1;
+  }
+  string eventfile = argv[1];
+  int nthreads = (argc > 2) ? atoi(argv[2]) : thread::hardware_concurrency();
+  int batchsize = (argc > 3) ? atoi(argv[3]) : 4096;
+  float seedcut = (argc > 4) ? atof(argv[4]) : 100;
+  float cellcut = (argc > 5) ? atof(argv[5]) : 10;
+  if( nthreads < 1 ) nthreads = 1;
+  if( batchsize < 1 ) batchsize = 1;
+
+  Layout layout;
+  if( !layout.read( "ecal_layout.txt" ) ) return 1;
+  EventReader reader;
+  if( !reader.open( eventfile ) ) return 1;
+
+  int nmodules = layout.size();
+  ClusterBatch batch( layout, seedcut, cellcut, nthreads );
+  vector<float> energies;
+  vector<vector<Cluster> > clusters;
+  Event event;
+  long long nevents = 0, nclusters = 0, nempty = 0;
+  double clustering = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  bool more = true;
+  while( more ) {
+    // Expand the next batch to dense energies indexed like the layout
+    energies.assign( long(batchsize) * nmodules, 0 );
+    int n = 0;
+    while( n < batchsize && (more = reader.next( event )) ) {
+      float* dense = &energies[0] + long(n) * nmodules;
+      for( int k=0; k<int(event.cells.size()); k++ ) {
+	int index = layout.index( event.cells[k] );
+	if( index >= 0 ) dense[index] += event.energy[k];
+      }
+      n++;
+    }
+    if( n == 0 ) break;
+    energies.resize( long(n) * nmodules );
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    batch.process( energies, clusters );
+    clustering += chrono::duration<double>( chrono::steady_clock::now() - begin ).count();
+
+    for( int ev=0; ev<n; ev++ ) {
+      nclusters += clusters[ev].size();
+      if( clusters[ev].empty() ) nempty++;
+    }
+    nevents += n;
+  }
+  double total = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+  cout << nevents << " events, " << nclusters << " clusters, "
+       << nempty << " events without a cluster" << endl;
+  if( nevents > 0 ) {
+    cout << "mean clusters per event " << double(nclusters) / nevents << endl;
+  }
+  cout << "clustering " << clustering << " s on " << nthreads << " threads, "
+       << ( clustering > 0 ? nevents / clustering : 0 ) << " events/s; "
+       << total << " s including reading" << endl;
+  return 0;
+}
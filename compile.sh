@@ -2,15 +2,23 @@
 
 echo "Compiling..."
 echo " "
+# -O3 lets gcc vectorise the per-group loops in LogicParams
+# CORE objects do not need SFML and are shared with the offline tools
+CORE="Layout.o ClusterFinder.o LogicTable.o LogicParams.o StreamRate.o Profiler.o RegionMask.o LogicExport.o EventFile.o ShowerGenerator.o LogicIndex.o ShardRunner.o EventPipeline.o Histograms.o CoverageMap.o WindowTrigger.o EfficiencyMap.o ScratchArena.o LogicBuilder.o TaskGraph.o LogicSnapshot.o"
+VIEWER="ECal.o Replay.o"
+TOOLS="stream_rate bench_logic shower_gen read_logic batch_run pipeline coverage_map window_trigger efficiency_map cluster_batch fit_params hist_merge"
 cd src/
-g++ -c main.cpp ECal.cpp -I/Documents/SFML/SFML_SRC/include 
+g++ -std=c++11 -O3 -pthread -c main.cpp ${VIEWER//.o/.cpp} ${CORE//.o/.cpp} -I/Documents/SFML/SFML_SRC/include 
 echo "Linking..."
 echo " "
 
 mv *.o ../linkers
 cd ../linkers
 
-g++ main.o ECal.o -o ecal -L/Documents/SFML/SFML_SRC/lib -lsfml-graphics -lsfml-window -lsfml-system
+g++ main.o $VIEWER $CORE -o ecal -pthread -L/Documents/SFML/SFML_SRC/lib -lsfml-graphics -lsfml-window -lsfml-system
+for tool in $TOOLS; do
+    g++ -std=c++11 -O3 -pthread ../$tool.cpp $CORE -o ../$tool
+done
 
 mv ecal ../
 cd ../
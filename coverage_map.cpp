@@ -0,0 +1,47 @@
+// Sub-module coverage of a logic file.
+//
+// usage: coverage_map [logic file] [pixel mm] [image.pgm|-] [region]
+//
+// Prints the glass area, the gaps between modules and the glass area
+// covered by 0, 1, 2 ... patterns, optionally with a greyscale map. The
+// region is a RegionMask rule, e.g. "file TE_layout_oct13.txt", and
+// limits the multiplicity count to its modules.
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+
+#include "include/Layout.hh"
+#include "include/LogicTable.hh"
+#include "include/RegionMask.hh"
+#include "include/CoverageMap.hh"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  string logicfile = (argc > 1) ? argv[1] : "full_logic_sept25.txt";
+  float pixel = (argc > 2) ? atof(argv[2]) : 1.0;
+  string image = (argc > 3) ? argv[3] : "-";
+  string rule = (argc > 4) ? argv[4] : "all";
+
+  Layout layout;
+  LogicTable logic;
+  if( !layout.read( "ecal_layout.txt" ) ) return 1;
+  if( !logic.read( logicfile ) || !logic.bind( layout ) ) return 1;
+
+  RegionMask region;
+  if( !RegionMask::parse( layout, rule, region ) ) return 1;
+
+  CoverageMap map( layout, pixel );
+  map.setregion( region );
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  map.addlogic( logic );
+  vector<long> counts;
+  map.multiplicity( counts );
+  double ms = 1e3 * chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+  map.report( cout );
+  cout << "rasterised and counted in " << ms << " ms" << endl;
+  if( image != "-" && !map.writepgm( image ) ) return 1;
+  return 0;
+}
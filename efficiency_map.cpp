@@ -0,0 +1,53 @@
+// Trigger efficiency map over the TE region.
+//
+// usage: efficiency_map [logic file] [step mm] [energy GeV] [threads] [region]
+//
+// The region defaults to the crescent in TE_layout_oct13.txt and may be
+// any RegionMask rule. Thresholds come from param_dontdelete.txt when it
+// matches the logic file. Writes efficiency_map.txt (one line per grid
+// point) and efficiency_groups.txt (one line per pattern).
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include "include/Layout.hh"
+#include "include/LogicTable.hh"
+#include "include/LogicParams.hh"
+#include "include/RegionMask.hh"
+#include "include/ShowerGenerator.hh"
+#include "include/EfficiencyMap.hh"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  string logicfile = (argc > 1) ? argv[1] : "full_logic_sept25.txt";
+  float step = (argc > 2) ? atof(argv[2]) : 2.0;
+  float energy = 1000 * ( (argc > 3) ? atof(argv[3]) : 3.0 );
+  int nthreads = (argc > 4) ? atoi(argv[4]) : thread::hardware_concurrency();
+  string rule = (argc > 5) ? argv[5] : "file TE_layout_oct13.txt";
+
+  Layout layout;
+  LogicTable logic;
+  if( !layout.read( "ecal_layout.txt" ) ) return 1;
+  if( !logic.read( logicfile ) || !logic.bind( layout ) ) return 1;
+  RegionMask region;
+  if( !RegionMask::parse( layout, rule, region ) ) return 1;
+
+  // A parameter table for another logic version is ignored
+  LogicParams params;
+  bool thresholds = params.read( "param_dontdelete.txt", logic.groups() );
+
+  ShowerGenerator generator( layout );
+  EfficiencyMap map( layout, logic, generator, step );
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  map.scan( region, energy, thresholds ? &params : 0, nthreads );
+  double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+  map.report( cout, 0.9 );
+  cout << "scanned in " << seconds << " s on " << nthreads << " threads" << endl;
+  if( !map.writemap( "efficiency_map.txt" ) ) return 1;
+  if( !map.writegroups( "efficiency_groups.txt" ) ) return 1;
+  return 0;
+}
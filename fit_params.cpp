@@ -0,0 +1,126 @@
+// Refit the per-pattern trigger parameters from simulated showers.
+//
+// usage: fit_params <events|-> [logic file] [output] [threads] [nsigma] [max events] [start table]
+//
+// Events are in the EventFile text format, e.g. written by shower_gen
+// with showers spread over the face. Every event is reduced to its group
+// sums, LogicParams::fit() refits peak, width and threshold of all
+// patterns and the table is written in the param_dontdelete.txt format
+// (default param_refit.txt). Patterns with too few showers keep their
+// row of the start table (default param_dontdelete.txt) when it fits the
+// logic file, and are written as unfitted rows, which never fire,
+// otherwise. The new thresholds and turn-on curves of the refitted
+// patterns are then applied to the same sample as a check.
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <chrono>
+
+#include "include/Layout.hh"
+#include "include/LogicTable.hh"
+#include "include/LogicParams.hh"
+#include "include/EventFile.hh"
+
+using namespace std;
+
+double seconds(chrono::steady_clock::time_point start) {
+  return chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+}
+
+int main(int argc, char** argv) {
+  if( argc < 2 ) {
+    cerr << "usage: fit_params <events|-> [logic file] [output] [threads] [nsigma] [max events] [start table]" << endl;
+    return 1;
+  }
+  string eventfile = argv[1];
+  string logicfile = (argc > 2) ? argv[2] : "full_logic_sept25.txt";
+  string output = (argc > 3) ? argv[3] : "param_refit.txt";
+  int nthreads = (argc > 4) ? atoi(argv[4]) : thread::hardware_concurrency();
+  float nsigma = (argc > 5) ? atof(argv[5]) : 2.5;
+  long maxevents = (argc > 6) ? atol(argv[6]) : -1;
+  string startfile = (argc > 7) ? argv[7] : "param_dontdelete.txt";
+
+  Layout layout;
+  LogicTable logic;
+  if( !layout.read( "ecal_layout.txt" ) ) return 1;
+  if( !logic.read( logicfile ) || !logic.bind( layout ) ) return 1;
+  EventReader reader;
+  if( !reader.open( eventfile ) ) return 1;
+
+  // Group sums of every event, ngroups per event back to back
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  int ngroups = logic.groups();
+  vector<float> energy( layout.size(), 0 );
+  vector<float> sums;
+  Event event;
+  long nevents = 0;
+  while( nevents != maxevents && reader.next( event ) ) {
+    for( int k=0; k<int(event.cells.size()); k++ ) {
+      int index = layout.index( event.cells[k] );
+      if( index >= 0 ) energy[index] += event.energy[k];
+    }
+    sums.resize( sums.size() + ngroups );
+    logic.groupsums( &energy[0], &sums[0] + long(nevents)*ngroups );
+    for( int k=0; k<int(event.cells.size()); k++ ) {
+      int index = layout.index( event.cells[k] );
+      if( index >= 0 ) energy[index] = 0;
+    }
+    nevents++;
+  }
+  double reading = seconds( start );
+  if( nevents == 0 ) {
+    cerr << "No events in " << eventfile << endl;
+    return 1;
+  }
+
+  LogicParams params;
+  if( !params.read( startfile, ngroups ) ) {
+    cerr << "Patterns without enough showers are left unfitted" << endl;
+    params.resize( 0 );    // drop the rows that were read
+    params.resize( ngroups );
+  }
+  start = chrono::steady_clock::now();
+  params.fit( sums, nthreads, nsigma );
+  double fitting = seconds( start );
+  if( !params.write( output ) ) return 1;
+
+  int nfitted = 0, nkept = 0;
+  for( int g=0; g<ngroups; g++ ) {
+    if( params.refit(g) ) nfitted++;
+    else if( params.fitted(g) ) nkept++;
+  }
+
+  // Apply the new table: hard thresholds and the smeared turn-on
+  start = chrono::steady_clock::now();
+  vector<unsigned char> fired( sums.size() );
+  vector<float> response( sums.size() );
+  params.passthreshold( &sums[0], nevents, &fired[0] );
+  params.turnon( &sums[0], nevents, &response[0] );
+  double applying = seconds( start );
+
+  long ntriggered = 0;
+  double expected = 0;
+  for( long ev=0; ev<nevents; ev++ ) {
+    // The event triggers if any refitted pattern fires, its turn-on
+    // probability is taken from the one closest to firing
+    bool any = false;
+    float best = 0;
+    for( int g=0; g<ngroups; g++ ) {
+      if( !params.refit(g) ) continue;
+      any = any || fired[ ev*ngroups + g ];
+      if( response[ ev*ngroups + g ] > best ) best = response[ ev*ngroups + g ];
+    }
+    ntriggered += any;
+    expected += best;
+  }
+
+  cout << nevents << " events, " << nfitted << " of " << ngroups << " patterns fitted, written to " << output << endl;
+  cout << "too few showers: " << nkept << " kept from " << startfile << ", "
+       << ngroups - nfitted - nkept << " unfitted and never fire" << endl;
+  cout << "refitted patterns only: triggered " << ntriggered << " (" << 100.0*ntriggered/nevents << "%), turn-on expects "
+       << 100.0*expected/nevents << "%" << endl;
+  cout << "group sums " << reading << " s, fit " << fitting << " s on " << nthreads
+       << " threads, thresholds and turn-on " << applying << " s" << endl;
+  return 0;
+}
@@ -0,0 +1,37 @@
+// Sum binary histogram files, e.g. from pipeline runs over parts of a
+// sample, and write the total.
+//
+// usage: hist_merge <output> <histograms.bin> [histograms.bin ...]
+//
+// The first input sets the booking, every other one has to match it.
+// The output is binary when its name ends in .bin and text otherwise
+// ("-" for stdout), so a single input is simply converted.
+#include <iostream>
+#include <string>
+
+#include "include/Histograms.hh"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  if( argc < 3 ) {
+    cerr << "usage: hist_merge <output> <histograms.bin> [histograms.bin ...]" << endl;
+    return 1;
+  }
+  string output = argv[1];
+
+  HistogramSet histograms;
+  for( int i=2; i<argc; i++ ) {
+    if( !histograms.readbinary( argv[i] ) ) return 1;
+  }
+  long nhistograms = 0;
+  for( int f=0; f<histograms.size(); f++ ) nhistograms += histograms.family(f).count;
+  cerr << argc-2 << " files, " << histograms.size() << " families, "
+       << nhistograms << " histograms" << endl;
+
+  if( output.size() > 4 && output.compare( output.size()-4, 4, ".bin" ) == 0 ) {
+    if( !histograms.writebinary( output ) ) return 1;
+  }
+  else if( !histograms.writetext( output ) ) return 1;
+  return 0;
+}
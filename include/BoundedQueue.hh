@@ -0,0 +1,93 @@
+#ifndef BOUNDEDQUEUE_HH
+#define BOUNDEDQUEUE_HH
+
+#include <atomic>
+#include <cstddef>
+
+// Fixed capacity multi-producer multi-consumer queue without locks
+// (D. Vyukov's bounded queue). Every slot carries a sequence number
+// that says whether it is ready to be written or read on the current
+// lap, so push() and pop() each cost one compare-and-swap when there is
+// no contention. Both return false instead of blocking; the caller
+// decides how to wait.
+template<class T>
+class BoundedQueue {
+
+private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  Slot* slots;
+  size_t mask;
+  // Padding keeps the two ends on separate cache lines, so producers and
+  // consumers do not invalidate each other
+  char padtail[64];
+  std::atomic<size_t> tail;
+  char padhead[64];
+  std::atomic<size_t> head;
+
+  BoundedQueue(const BoundedQueue&);
+  BoundedQueue& operator=(const BoundedQueue&);
+
+public:
+  // Capacity is rounded up to a power of two
+  explicit BoundedQueue(size_t capacity) {
+    size_t size = 2;
+    while( size < capacity ) size *= 2;
+    slots = new Slot[size];
+    mask = size - 1;
+    for( size_t i=0; i<size; i++ ) slots[i].sequence.store( i, std::memory_order_relaxed );
+    tail.store( 0, std::memory_order_relaxed );
+    head.store( 0, std::memory_order_relaxed );
+  }
+  ~BoundedQueue() { delete [] slots; }
+
+  size_t capacity() const { return mask + 1; }
+
+  bool push(const T& value) {
+    size_t pos = tail.load( std::memory_order_relaxed );
+    while( true ) {
+      Slot& slot = slots[ pos & mask ];
+      size_t seq = slot.sequence.load( std::memory_order_acquire );
+      long diff = long(seq) - long(pos);
+      if( diff == 0 ) {
+	if( tail.compare_exchange_weak( pos, pos+1, std::memory_order_relaxed ) ) {
+	  slot.value = value;
+	  slot.sequence.store( pos+1, std::memory_order_release );
+	  return true;
+	}
+      }
+      else if( diff < 0 ) {
+	return false;    // full
+      }
+      else {
+	pos = tail.load( std::memory_order_relaxed );
+      }
+    }
+  }
+
+  bool pop(T& value) {
+    size_t pos = head.load( std::memory_order_relaxed );
+    while( true ) {
+      Slot& slot = slots[ pos & mask ];
+      size_t seq = slot.sequence.load( std::memory_order_acquire );
+      long diff = long(seq) - long(pos+1);
+      if( diff == 0 ) {
+	if( head.compare_exchange_weak( pos, pos+1, std::memory_order_relaxed ) ) {
+	  value = slot.value;
+	  slot.sequence.store( pos + mask + 1, std::memory_order_release );
+	  return true;
+	}
+      }
+      else if( diff < 0 ) {
+	return false;    // empty
+      }
+      else {
+	pos = head.load( std::memory_order_relaxed );
+      }
+    }
+  }
+};
+#endif
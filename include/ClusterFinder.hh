@@ -0,0 +1,50 @@
+#ifndef CLUSTERFINDER_HH
+#define CLUSTERFINDER_HH
+
+#include "Layout.hh"
+#include <vector>
+
+struct Cluster {
+  int seed;        // module index of the seed
+  int ncells;
+  float energy;
+  float x, y;      // energy weighted centroid in layout coordinates (mm)
+};
+
+// Offline cluster finder. Energies are dense per event and indexed like
+// Layout::module(). Every scratch buffer is sized to the module count in
+// the constructor, so findclusters() does not touch the heap once the
+// caller's cluster vector has reached its working size.
+class ClusterFinder {
+
+private:
+  const Layout* layout;
+  float seedcut, cellcut;
+  int nrings;
+
+  std::vector<int> seeds;
+  std::vector<int> owner, touched;
+  std::vector<int> ring, nextring;
+
+public:
+  ClusterFinder(const Layout&, float, float, int rings = 2);
+  ~ClusterFinder() {};
+
+  int findclusters(const float*, std::vector<Cluster>&);
+};
+
+// Runs one ClusterFinder per thread over batches of events. A batch is a
+// flat array of nevents * layout.size() energies.
+class ClusterBatch {
+
+private:
+  int stride;
+  std::vector<ClusterFinder> finders;
+
+public:
+  ClusterBatch(const Layout&, float, float, int);
+  ~ClusterBatch() {};
+
+  void process(const std::vector<float>&, std::vector<std::vector<Cluster> >&);
+};
+#endif
@@ -0,0 +1,69 @@
+#ifndef COVERAGEMAP_HH
+#define COVERAGEMAP_HH
+
+#include "Layout.hh"
+#include "LogicTable.hh"
+#include "RegionMask.hh"
+#include <vector>
+#include <string>
+#include <ostream>
+#include <stdint.h>
+
+// The detector face rasterised on a square pixel grid, one bit per
+// pixel and 64 pixels per word. A pixel belongs to a module when its
+// centre lies inside the module square, so the 42/40/38 mm blocks keep
+// their real extent and the slivers between rows of different size show
+// up as gaps.
+//
+// Patterns are counted bit-sliced: plane k holds bit k of the number of
+// patterns covering each pixel, and adding a pattern is a ripple-carry
+// add of its bitmap through the planes, 64 pixels per word operation.
+class CoverageMap {
+
+public:
+  enum { kPlanes = 3 };     // multiplicities up to 7 are exact, more saturate
+
+private:
+  const Layout* layout;
+  float pixel, x0, y0;
+  int width, height, words;
+  int ngroups;
+
+  std::vector<uint64_t> glass;       // inside a module
+  std::vector<uint64_t> envelope;    // between the first and last module of a pixel row
+  std::vector<uint64_t> region;      // glass the multiplicities are counted over
+  std::vector<uint64_t> planes;      // kPlanes bitmaps, then the saturation bitmap
+  std::vector<uint64_t> scratch;
+
+  uint64_t* plane(int k) { return &planes[0] + long(k)*height*words; }
+  const uint64_t* plane(int k) const { return &planes[0] + long(k)*height*words; }
+  void span(uint64_t*, int, int) const;
+  bool pixels(int, int&, int&, int&, int&) const;
+
+public:
+  CoverageMap(const Layout&, float pixelsize = 1.0);
+  ~CoverageMap() {};
+
+  void clear();
+  // Count multiplicities only over the modules of a region, e.g. the TE
+  // crescent; the whole detector by default
+  void setregion(const RegionMask&);
+  void addgroup(const int*, int);
+  void addlogic(const LogicTable&);
+
+  int groups() const { return ngroups; }
+  float pixelsize() const { return pixel; }
+  // Areas in pixels, multiply by pixelsize()^2 for mm^2
+  long glassarea() const;
+  long gaparea() const;
+  long regionarea() const;
+  // counts[m] is the region area covered by exactly m patterns, the
+  // last entry collects everything from 2^kPlanes - 1 up
+  void multiplicity(std::vector<long>&) const;
+
+  void report(std::ostream&) const;
+  // 8-bit greyscale map: black outside, dark grey for gaps, white for
+  // glass in no pattern, darker the more patterns cover a pixel
+  bool writepgm(const std::string&) const;
+};
+#endif
@@ -6,6 +6,11 @@
 #include <map>
 #include <set>
 
+#include "Layout.hh"
+#include "RegionMask.hh"
+#include "LogicSnapshot.hh"
+#include "TaskGraph.hh"
+
 class ECal : public sf::Drawable, public sf::Transformable {
 
 private:
@@ -18,10 +23,11 @@ private:
   int ecalminy, ecalmaxy, ecalminx, ecalmaxx;
   int countnodes;
   int maxclustersize;
-  float clustercutx, clustercutxneg, clustercuty;
 
-  // Trigger Efficiency Calorimeter Shape
+  // Module table and the Trigger Efficiency Calorimeter Shape
   // we need to exclude the perimeter modules
+  Layout table;
+  RegionMask TEregion;
   std::map<int, std::vector<int> > triggermap;
 
   // MODULE and LOGIC Properties
@@ -31,9 +37,12 @@ private:
 
   std::vector<sf::RectangleShape> modules;
   std::vector<sf::RectangleShape>::iterator modit;
-  std::map<int,sf::RectangleShape> modmap, cluster, final, modmapTE;
+  std::map<int,sf::RectangleShape> modmap, final, modmapTE;
   std::map<int,sf::RectangleShape>::iterator mapit, clustit, clusterit, lastone;
 
+  // The groups drawn are made from the current snapshot in history
+  LogicBuilder builder;
+  LogicHistory history;
   std::vector<std::map<int,sf::RectangleShape> > global_logic;
   std::vector<std::map<int,sf::RectangleShape> >::iterator glit, glit_rest;
 
@@ -54,21 +63,46 @@ private:
   sf::Text textind;
 
   // Control drawings with keyboard 
-  float time;
   bool logboarders;
   bool logcolors;
   bool crescent;
-  bool control;
   bool indexthenodes, indexthemods;
-  int count1, count2, count3, count4, count5;
+
+  // Cached drawing layers, composited in draw()
+  enum Layer { kModules, kFills, kBorders, kNodeLabels, kModLabels, kLayers };
+  mutable sf::RenderTexture layers[kLayers];
+  mutable sf::FloatRect layerrect;
+  mutable bool layerdirty[kLayers];
+  mutable bool layerscached;
+
+  // Start up: the geometry is built before the first frame, everything
+  // else is a task. A layer is only drawn once its task has been polled.
+  TaskGraph startuptasks;
+  int layertask[kLayers];
+  bool layerready[kLayers];
+  int polledtasks;
+
+  void loadfont();
+  void showlogic();
+  void relayout(const char*);
+  void drawlayer(sf::RenderTarget&, int) const;
+  void drawcached(sf::RenderTarget&, int, bool) const;
+  void renderlayers() const;
 
 public:
   ECal(float,float);
-  ~ECal() {};
+  ~ECal() { startuptasks.wait(); }
 
   void draw(sf::RenderTarget&, sf::RenderStates) const;
-  void controldrawings(sf::Time);
+  bool handlekey(sf::Keyboard::Key);
+  bool handleclick(sf::Vector2f, bool);
+  void invalidate() { for( int l=0; l<kLayers; l++ ) layerdirty[l] = true; }
+  void invalidate(int layer) { layerdirty[layer] = true; }
   void initializeECal();
+  void startup();
+  bool update();
+  bool loading() const { return polledtasks < startuptasks.size(); }
+  void finish();
   void specs();
   void triggerlogic();
   void colorthelogic();
@@ -77,5 +111,10 @@ public:
   void indexnodes();
   bool index() { return indexthenodes; }
   void logicinfo();
+  const Layout& moduletable() const { return table; }
+  const std::map<int,sf::RectangleShape>& modulemap() const { return modmap; }
+  const std::vector<std::map<int,sf::RectangleShape> >& logic() const { return global_logic; }
+  const std::vector<std::vector<sf::VertexArray> >& logicboarders() const { return manyboarders; }
+  const RegionMask& TEcells() const { return TEregion; }
 };
 #endif
@@ -0,0 +1,57 @@
+#ifndef EFFICIENCYMAP_HH
+#define EFFICIENCYMAP_HH
+
+#include "Layout.hh"
+#include "LogicTable.hh"
+#include "LogicParams.hh"
+#include "RegionMask.hh"
+#include "ShowerGenerator.hh"
+#include <vector>
+#include <string>
+#include <ostream>
+
+// Position resolved trigger efficiency over a region. Impact points sit
+// on a square grid; a point is scanned when it lands on a module of the
+// region. For every point the expected shower footprint is spread over
+// the modules and the pattern capturing the largest share of the energy
+// is kept, together with whether any pattern passes its threshold.
+//
+// The grid is cut into square tiles that the threads take in turn, and
+// every point only visits the patterns of the modules it reaches.
+class EfficiencyMap {
+
+private:
+  const Layout* layout;
+  const LogicTable* logic;
+  const ShowerGenerator* generator;
+  float step, x0, y0;
+  int nx, ny;
+  int tilesize;
+
+  // Patterns of every module, compressed like LogicTable
+  std::vector<int> modstart, modgroups;
+
+  std::vector<unsigned char> inside, pass;
+  std::vector<float> best;
+  std::vector<int> bestgroup;
+  int npoints;
+
+  void scantile(int, int, float, const LogicParams*, std::vector<float>&, std::vector<int>&,
+		std::vector<int>&, std::vector<float>&);
+
+public:
+  EfficiencyMap(const Layout&, const LogicTable&, const ShowerGenerator&, float step = 5.0);
+  ~EfficiencyMap() {};
+
+  // energy in MeV, thresholds from params when given
+  void scan(const RegionMask&, float, const LogicParams*, int, int tile = 32);
+
+  int points() const { return npoints; }
+  // One line per scanned point: x y best-fraction best-pattern pass.
+  // Patterns are numbered from 1 in both files, as in every tool
+  bool writemap(const std::string&) const;
+  // One line per pattern: points where it is best, mean and lowest share there
+  bool writegroups(const std::string&) const;
+  void report(std::ostream&, float) const;
+};
+#endif
@@ -0,0 +1,59 @@
+#ifndef EVENTFILE_HH
+#define EVENTFILE_HH
+
+#include <vector>
+#include <string>
+#include <cstdio>
+
+// Module energies of one event, only the modules that were hit
+struct Event {
+  int id;
+  std::vector<int> cells;
+  std::vector<float> energy;   // MeV
+
+  void clear() { cells.clear(); energy.clear(); }
+  void add(int cell, float e) { cells.push_back( cell ); energy.push_back( e ); }
+};
+
+// Text event files:
+//   event <id> <nhits>
+//   <cell> <energy>      (nhits lines)
+// Lines starting with '#' are comments.
+class EventReader {
+
+private:
+  FILE* file;
+  char line[256];
+
+public:
+  EventReader() : file(0) {}
+  ~EventReader() { close(); }
+
+  bool open(const std::string&);
+  void close();
+  bool rewind();
+  // Reuses the vectors of the event, so reading does not allocate once
+  // they are large enough
+  bool next(Event&);
+  // The same in two steps: the lines of the next event, header first
+  // and without comments, and the event parsed from them. Only the
+  // first touches the file, so several threads can share a reader and
+  // parse in parallel.
+  bool nextraw(std::string&);
+  static bool parse(const std::string&, Event&);
+};
+
+class EventWriter {
+
+private:
+  FILE* file;
+
+public:
+  EventWriter() : file(0) {}
+  ~EventWriter() { close(); }
+
+  bool open(const std::string&);
+  void close();
+  void write(const Event&);
+};
+#endif
@@ -0,0 +1,95 @@
+#ifndef EVENTPIPELINE_HH
+#define EVENTPIPELINE_HH
+
+#include "Layout.hh"
+#include "LogicTable.hh"
+#include "LogicParams.hh"
+#include "ClusterFinder.hh"
+#include "EventFile.hh"
+#include "BoundedQueue.hh"
+#include "Histograms.hh"
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <ostream>
+
+// One event on its way through the pipeline. Items come from a fixed
+// pool and go back to it after the last stage, so nothing is allocated
+// once every vector has grown to its working size.
+struct PipelineItem {
+  std::string raw;                  // event lines as read from the file
+  Event event;
+  std::vector<float> energy;        // dense, indexed like Layout::module()
+  std::vector<Cluster> clusters;
+  std::vector<float> sums;          // one per logic pattern
+  std::vector<unsigned char> fired;
+  int nfired;
+};
+
+// Event study as four stages joined by bounded lock-free queues:
+//
+//   decode -> cluster -> trigger -> histogram -> back to the free pool
+//
+// Every stage runs its own set of threads. The pool holds depth items,
+// so a slow stage fills the queue in front of it and the decoder stalls
+// until items come back, instead of reading the whole file ahead.
+// Decode threads share the reader only to fetch the lines of an event
+// and parse them in parallel. A thread with nothing to do sleeps on its
+// queue until an item is pushed or the stage before it finishes.
+class EventPipeline {
+
+public:
+  enum Stage { kDecode, kCluster, kTrigger, kHistogram, kStages };
+
+private:
+  struct StageCounters {
+    std::atomic<long> items, busy, stalls;   // busy in ns
+    std::atomic<int> running;
+    std::atomic<bool> finished;
+  };
+  // Sleeping takers of one queue, pushers only lock when there are any
+  struct QueueWaiters {
+    std::mutex lock;
+    std::condition_variable moved;
+    std::atomic<int> waiting;
+  };
+
+  const Layout* layout;
+  const LogicTable* logic;
+  const LogicParams* params;
+  float seedcut, cellcut;
+  int depth;
+  int threads[kStages];
+
+  // queues[s] feeds stage s, queues[kDecode] is the free pool
+  BoundedQueue<PipelineItem*>* queues[kStages];
+  std::vector<PipelineItem> pool;
+  StageCounters counters[kStages];
+  QueueWaiters waiters[kStages];
+  EventReader* reader;
+  std::mutex readlock;
+  HistogramSet histograms;
+  int hgroupsum, hclusterenergy, hclusters, hhits, hfired, hnfired;
+  double seconds;
+
+  void worker(int);
+  bool take(int, PipelineItem*&);
+  void give(int, PipelineItem*);
+  void wake(int);
+
+public:
+  EventPipeline(const Layout&, const LogicTable&, const LogicParams&, int depth = 256);
+  ~EventPipeline();
+
+  void setthreads(Stage s, int n) { threads[s] = n > 0 ? n : 1; }
+  void setcuts(float seed, float cell) { seedcut = seed; cellcut = cell; }
+
+  void run(EventReader&);
+  // groupsum (one per pattern), clusterenergy, clusters, hits, fired
+  // (bin per pattern) and nfired, summed over the histogram threads
+  const HistogramSet& results() const { return histograms; }
+  void report(std::ostream&) const;
+};
+#endif
@@ -0,0 +1,92 @@
+#ifndef HISTOGRAMS_HH
+#define HISTOGRAMS_HH
+
+#include <vector>
+#include <string>
+#include <mutex>
+
+// A family of histograms with the same binning, e.g. one group-sum
+// spectrum per logic pattern. Every histogram has an underflow bin 0
+// and an overflow bin nbins+1 around the nbins regular bins.
+struct HistogramFamily {
+  std::string name;
+  int count, nbins;
+  float lo, hi, scale;
+  long offset;            // first bin of histogram 0 in the flat storage
+  int stride;             // nbins + 2
+};
+
+class HistogramSet;
+
+// Bins of every booked histogram in one flat array, owned and filled by
+// one thread. Filling is a plain increment, there are no locks or
+// atomics; buffers are added into the HistogramSet when a thread is done
+// or whenever its owner wants a partial result.
+class HistogramBuffer {
+
+private:
+  const std::vector<HistogramFamily>* families;
+  std::vector<long> bins;
+
+  friend class HistogramSet;
+
+public:
+  HistogramBuffer() : families(0) {}
+  ~HistogramBuffer() {};
+
+  static int binof(const HistogramFamily& f, float x) {
+    float t = ( x - f.lo ) * f.scale;
+    if( !( t >= 0 ) ) return 0;
+    return ( t >= f.nbins ) ? f.nbins+1 : int(t)+1;
+  }
+  void fill(int family, int h, float x) {
+    const HistogramFamily& f = (*families)[family];
+    bins[ f.offset + long(h)*f.stride + binof( f, x ) ]++;
+  }
+  // Histogram h of the family gets x[h], for every h
+  void fillall(int, const float*);
+  void clear();
+};
+
+// Booking, merged totals and output. Book everything before creating the
+// buffers; add() is the only call that takes the lock.
+class HistogramSet {
+
+private:
+  std::vector<HistogramFamily> families;
+  std::vector<long> total;
+  std::mutex lock;
+
+public:
+  HistogramSet() {};
+  ~HistogramSet() {};
+
+  int book(const std::string&, int, int, float, float);
+  int find(const std::string&) const;
+  int size() const { return families.size(); }
+  const HistogramFamily& family(int f) const { return families[f]; }
+
+  void attach(HistogramBuffer&) const;
+  // Adds the buffer into the totals and clears it
+  void add(HistogramBuffer&);
+  void clear();
+
+  long content(int family, int h, int bin) const {
+    const HistogramFamily& f = families[family];
+    return total[ f.offset + long(h)*f.stride + bin ];
+  }
+  long entries(int, int) const;
+
+  // Text: one "# name h nbins lo hi" line per histogram, then its bins
+  // from underflow to overflow on one line. Binary, all little endian:
+  // "ECLH", uint32 version 2 and family count, per family the uint32
+  // name length, the name, uint32 count and nbins, float lo and hi. The
+  // flat bins follow as runs of uint32 empty bins, uint32 filled bins
+  // and one uint64 per filled bin, so sparse spectra stay small.
+  bool writetext(const std::string&) const;
+  bool writebinary(const std::string&) const;
+  // Adds a binary file with the same booking into the totals; a set
+  // with nothing booked takes the booking of the file
+  bool readbinary(const std::string&);
+};
+#endif
@@ -0,0 +1,49 @@
+#ifndef LAYOUT_HH
+#define LAYOUT_HH
+
+#include <vector>
+#include <string>
+
+// One row of ecal_layout.txt. Positions are in mm relative to the
+// ECal center, i.e. the same system as the layout file and G4SBS.
+struct Module {
+  int type, cell, row, col, ncol;
+  float x, y;
+};
+
+// Plain module table, independent of SFML so that the offline tools
+// can share it with the viewer.
+class Layout {
+
+private:
+  std::vector<Module> modules;
+  std::vector<int> cellindex;
+  int maxrow, maxcellnumber;
+
+  // Neighbour table in compressed form: the neighbours of module i are
+  // neighborlist[ neighborstart[i] ] ... neighborlist[ neighborstart[i+1]-1 ]
+  std::vector<int> neighborstart, neighborlist;
+
+public:
+  Layout();
+  ~Layout() {};
+
+  bool read(const std::string&);
+  void buildneighbors(float);
+
+  int size() const { return modules.size(); }
+  int rows() const { return maxrow; }
+  int maxcell() const { return maxcellnumber; }
+  const Module& module(int i) const { return modules[i]; }
+  const std::vector<Module>& table() const { return modules; }
+
+  // Module index of a cell number, -1 if the cell does not exist
+  int index(int cell) const {
+    return ( cell >= 0 && cell < int(cellindex.size()) ) ? cellindex[cell] : -1;
+  }
+  const int* neighbors(int i, int& n) const {
+    n = neighborstart[i+1] - neighborstart[i];
+    return neighborlist.empty() ? 0 : &neighborlist[0] + neighborstart[i];
+  }
+};
+#endif
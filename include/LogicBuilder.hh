@@ -0,0 +1,42 @@
+#ifndef LOGICBUILDER_HH
+#define LOGICBUILDER_HH
+
+#include "ScratchArena.hh"
+#include <vector>
+
+// Builds logic groups for a list of nodes with the LogicKernel routines
+// and keeps them in one flat store: the cells of group g are
+// cell( first(g) ) ... cell( first(g+1)-1 ), in ascending cell number
+// like the std::map the viewer fills from them. Every pass bins the
+// modules into a coarse grid and each node hands the kernels only the
+// modules near it. That scratch, sized by the module set and by the node,
+// comes from a ScratchArena and the store is only cleared between
+// builds, so rebuilding a node set of the same size does not allocate.
+class LogicBuilder {
+
+private:
+  ScratchArena arena;
+  std::vector<int> cellnumbers;
+  std::vector<float> cellx, celly;
+  std::vector<int> groupstart, groupcells;
+
+public:
+  LogicBuilder() {};
+  ~LogicBuilder() {};
+
+  // Modules as parallel arrays in ascending cell order
+  void setmodules(const int*, const float*, const float*, int);
+
+  // One group per node; maxcells selects the 32 or 64 module kernel,
+  // size is the module size the kernel cuts are expressed in
+  int build(const float*, const float*, int, int, float);
+
+  int groups() const { return int(groupstart.size()) - 1; }
+  int first(int g) const { return groupstart[g]; }
+  const int* group(int g, int& n) const {
+    n = groupstart[g+1] - groupstart[g];
+    return groupcells.empty() ? 0 : &groupcells[0] + groupstart[g];
+  }
+  const ScratchArena& scratch() const { return arena; }
+};
+#endif
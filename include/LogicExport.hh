@@ -0,0 +1,96 @@
+#ifndef LOGICEXPORT_HH
+#define LOGICEXPORT_HH
+
+#include <vector>
+#include <string>
+
+// Logic patterns gathered once for all writers. Positions are in mm in
+// the G4SBS system. The cells of pattern g are
+// cells[ groupstart[g] ] ... cells[ groupstart[g+1]-1 ].
+struct LogicExportData {
+  std::vector<int> groupstart;
+  std::vector<int> cells;
+  std::vector<float> x, y, size;
+  int count, count42, count40, count38;
+  int maxcell;          // largest cell in any pattern
+  int layoutmaxcell;    // largest cell of the layout, sizes the cell tables
+
+  LogicExportData() : count(0), count42(0), count40(0), count38(0), maxcell(0), layoutmaxcell(0) { groupstart.push_back(0); }
+  void add(int, float, float, float);
+  void endgroup() { groupstart.push_back( cells.size() ); }
+  int groups() const { return int(groupstart.size()) - 1; }
+};
+
+// A writer formats the whole file into memory; LogicExporter does the
+// file output, so every file is written with a single call.
+class LogicWriter {
+public:
+  virtual ~LogicWriter() {}
+  virtual std::string filename() const = 0;
+  virtual void format(const LogicExportData&, std::string&) const = 0;
+};
+
+// The text format read by G4SBS, as written by ECal::logicinfo()
+class G4SBSWriter : public LogicWriter {
+  std::string name;
+public:
+  G4SBSWriter(const std::string& file) : name(file) {}
+  std::string filename() const { return name; }
+  void format(const LogicExportData&, std::string&) const;
+};
+
+// group,cell,x,y,size with one row per module
+class CSVWriter : public LogicWriter {
+  std::string name;
+public:
+  CSVWriter(const std::string& file) : name(file) {}
+  std::string filename() const { return name; }
+  void format(const LogicExportData&, std::string&) const;
+};
+
+// "ECLG", version, ngroups, nentries, then groupstart, cells, x, y and
+// size as little endian int32/float32 arrays on any host
+class BinaryWriter : public LogicWriter {
+  std::string name;
+public:
+  BinaryWriter(const std::string& file) : name(file) {}
+  std::string filename() const { return name; }
+  void format(const LogicExportData&, std::string&) const;
+};
+
+// Firmware lookup table indexed by cell number, one $readmemh hex word
+// per cell with bit g set if the cell belongs to pattern g. Covers every
+// cell of the layout, not only those in a pattern.
+class CellMaskWriter : public LogicWriter {
+  std::string name;
+public:
+  CellMaskWriter(const std::string& file) : name(file) {}
+  std::string filename() const { return name; }
+  void format(const LogicExportData&, std::string&) const;
+};
+
+// Firmware lookup table indexed by pattern: cell count in 2 hex digits,
+// then the cell numbers in 3 hex digits each, zero padded to the largest
+// pattern so every word has the same width
+class GroupListWriter : public LogicWriter {
+  std::string name;
+public:
+  GroupListWriter(const std::string& file) : name(file) {}
+  std::string filename() const { return name; }
+  void format(const LogicExportData&, std::string&) const;
+};
+
+// Runs every writer on its own thread over the same data
+class LogicExporter {
+
+private:
+  std::vector<LogicWriter*> writers;
+
+public:
+  LogicExporter() {};
+  ~LogicExporter();
+
+  void add(LogicWriter* writer) { writers.push_back( writer ); }   // takes ownership
+  bool run(const LogicExportData&) const;
+};
+#endif
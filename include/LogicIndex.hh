@@ -0,0 +1,70 @@
+#ifndef LOGICINDEX_HH
+#define LOGICINDEX_HH
+
+#include "Layout.hh"
+#include "LogicTable.hh"
+#include <vector>
+#include <string>
+
+// Lookup tables over a LogicTable: cell -> patterns, point -> patterns,
+// pattern -> cells and pattern -> overlapping patterns. Every table is
+// in compressed form (start offsets plus one flat list), so a query is
+// one or two array reads. The whole index can be saved and loaded again
+// without the logic file or the layout.
+class LogicIndex {
+
+private:
+  int ngroups, maxcellnumber;
+
+  // Same layout as LogicTable: start offsets, then the flat list
+  std::vector<int> groupstart, groupcells;
+  std::vector<int> cellstart, cellgroups;
+  std::vector<int> neighborstart, neighborgroups;
+
+  // Modules of the logic file binned on a square grid for point lookups
+  std::vector<float> modx, mody, modhalf;
+  std::vector<int> modcell;
+  float binsize, minx, miny;
+  int nbinx, nbiny;
+  std::vector<int> binstart, binmodules;
+
+public:
+  LogicIndex();
+  ~LogicIndex() {};
+
+  void build(const LogicTable&, const Layout&);
+  bool save(const std::string&) const;
+  bool load(const std::string&);
+
+  int groups() const { return ngroups; }
+  int maxcell() const { return maxcellnumber; }
+
+  // Cell numbers of pattern g
+  const int* cells(int g, int& n) const {
+    if( g < 0 || g >= ngroups ) { n = 0; return 0; }
+    n = groupstart[g+1] - groupstart[g];
+    return groupcells.empty() ? 0 : &groupcells[0] + groupstart[g];
+  }
+  // Patterns containing a cell, in increasing order
+  const int* groupsofcell(int cell, int& n) const {
+    if( cell < 0 || cell > maxcellnumber ) { n = 0; return 0; }
+    n = cellstart[cell+1] - cellstart[cell];
+    return cellgroups.empty() ? 0 : &cellgroups[0] + cellstart[cell];
+  }
+  // Patterns sharing at least one cell with pattern g, g excluded
+  const int* neighbors(int g, int& n) const {
+    if( g < 0 || g >= ngroups ) { n = 0; return 0; }
+    n = neighborstart[g+1] - neighborstart[g];
+    return neighborgroups.empty() ? 0 : &neighborgroups[0] + neighborstart[g];
+  }
+  // Cell under a point, -1 between modules or off every pattern. Points
+  // are in the coordinates of the logic file the index was built from
+  // (ecal_logic_oct13.txt is shifted 40 mm in y from ecal_layout.txt,
+  // full_logic_sept25.txt has y flipped as well), so a position copied
+  // from the file finds its own cell.
+  int cellat(float, float) const;
+  const int* groupsatpoint(float x, float y, int& n) const {
+    return groupsofcell( cellat( x, y ), n );
+  }
+};
+#endif
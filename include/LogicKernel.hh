@@ -0,0 +1,137 @@
+#ifndef LOGICKERNEL_HH
+#define LOGICKERNEL_HH
+
+#include <cmath>
+
+// Shape of a logic group: at most MaxCells modules, at most RowWidth
+// modules in one row and at most Rows distinct rows. The half size of
+// the search box around a node, in units of 42 mm modules, belongs to
+// the shape and is set by the specialisations below.
+template <int MaxCells, int RowWidth, int Rows>
+struct LogicShape;
+
+template <>
+struct LogicShape<32,4,8> {
+  static float cutx() { return 2.1f; }
+  static float cuty() { return 4.1f; }
+};
+
+template <>
+struct LogicShape<64,8,8> {
+  static float cutx() { return 4.1f; }
+  static float cuty() { return 4.1f; }
+};
+
+// Logic group builder used by ECal::triggerlogic(), with every scratch
+// container sized at compile time from the shape. Modules are given as
+// flat position arrays in ascending cell order (the modmap order), and
+// results are indices into those arrays.
+template <int MaxCells, int RowWidth, int Rows>
+class LogicKernel {
+
+public:
+  typedef LogicShape<MaxCells,RowWidth,Rows> Shape;
+
+  static const int maxcells = MaxCells;
+  static const int rowwidth = RowWidth;
+  static const int rows = Rows;
+
+  // Modules that can fall inside the search box, with generous room for
+  // the staggered rows and the smallest (38 mm) modules
+  static const int maxcandidates = 4 * ( 2*Rows + 4 ) * ( 2*RowWidth + 4 );
+
+  // Module closest to the node
+  static int nearest(const float* x, const float* y, int n, float nodex, float nodey) {
+    int closest = -1;
+    float mindistance = 0;
+    for( int j=0; j<n; j++ ) {
+      double dx = nodex - x[j];
+      double dy = nodey - y[j];
+      float distance = sqrt( dx*dx + dy*dy );
+      if( closest == -1 || distance < mindistance ) {
+	mindistance = distance;
+	closest = j;
+      }
+    }
+    return closest;
+  }
+
+  // Grow a group from seed towards the node. Fills group with up to
+  // MaxCells module indices in the order they were added and returns the
+  // count. size is the module size (42 mm) the cuts are expressed in.
+  static int grow(const float* x, const float* y, int n, int seed,
+		  float nodex, float nodey, float size, int* group) {
+    const float cutx = Shape::cutx() * size;
+    const float cuty = Shape::cuty() * size;
+    const double reach = 1.2 * size;
+
+    // Only modules inside the box around the node can ever be added
+    int candidates[maxcandidates];
+    int ncandidates = 0;
+    for( int j=0; j<n && ncandidates<maxcandidates; j++ ) {
+      if( fabs( x[j] - nodex ) < cutx && fabs( y[j] - nodey ) < cuty ) {
+	candidates[ ncandidates++ ] = j;
+      }
+    }
+
+    // Row bookkeeping: rowy holds the distinct row positions seen so far
+    // and rowcount how often each was tried. Once there are more than
+    // Rows distinct rows nothing else can be added, so Rows+1 slots are
+    // enough.
+    float rowy[Rows+1];
+    int rowcount[Rows+1];
+    int nrows = 1;
+    rowy[0] = y[seed];
+    rowcount[0] = 1;
+
+    int ngroup = 0;
+    group[ ngroup++ ] = seed;
+    bool taken[maxcandidates];
+    for( int c=0; c<ncandidates; c++ ) {
+      taken[c] = ( candidates[c] == seed );
+    }
+
+    for( int k=0; k<ngroup && ngroup<MaxCells; k++ ) {
+      int member = group[k];
+      for( int c=0; c<ncandidates; c++ ) {
+	int j = candidates[c];
+	if( j == member || taken[c] ) continue;
+	double dx = x[j] - x[member];
+	double dy = y[j] - y[member];
+	float distance = sqrt( dx*dx + dy*dy );
+	if( distance >= reach ) continue;
+
+	// Every candidate tried counts towards its row, added or not
+	int r = 0;
+	while( r < nrows && rowy[r] != y[j] ) r++;
+	int count_in_row;
+	int count_rows;
+	if( r < nrows ) {
+	  count_in_row = ++rowcount[r];
+	  count_rows = nrows;
+	}
+	else if( nrows <= Rows ) {
+	  rowy[nrows] = y[j];
+	  rowcount[nrows] = 1;
+	  count_in_row = 1;
+	  count_rows = ++nrows;
+	}
+	else {
+	  count_in_row = 1;
+	  count_rows = nrows + 1;
+	}
+
+	if( count_in_row <= RowWidth && count_rows <= Rows ) {
+	  group[ ngroup++ ] = j;
+	  taken[c] = true;
+	  if( ngroup == MaxCells ) break;
+	}
+      }
+    }
+    return ngroup;
+  }
+};
+
+typedef LogicKernel<32,4,8> LogicKernel32;
+typedef LogicKernel<64,8,8> LogicKernel64;
+#endif
@@ -0,0 +1,46 @@
+#ifndef LOGICPARAMS_HH
+#define LOGICPARAMS_HH
+
+#include <vector>
+#include <string>
+
+// Per-pattern trigger parameters, one row of param_dontdelete.txt per
+// logic pattern in file order: peak and width of the group sum for
+// showers centred on that pattern, and the threshold placed below the
+// peak (mean - 2.5 sigma in the shipped table). A row of zero width is
+// a pattern that was never fitted: it is read with a threshold no sum
+// reaches, so it never fires, and written back as zeros.
+//
+// The columns are kept as separate arrays so the evaluators below run
+// straight down memory and the compiler can vectorise them across groups.
+class LogicParams {
+
+private:
+  std::vector<float> mean, sigma, threshold;
+  std::vector<unsigned char> refitted;
+
+public:
+  LogicParams() {};
+  ~LogicParams() {};
+
+  bool read(const std::string&, int);
+  bool write(const std::string&) const;
+  // New rows are unfitted and never fire
+  void resize(int);
+
+  int size() const { return mean.size(); }
+  float peak(int g) const { return mean[g]; }
+  float width(int g) const { return sigma[g]; }
+  float cut(int g) const { return threshold[g]; }
+  bool fitted(int g) const { return sigma[g] > 0; }
+  // Set by fit() for the patterns it refitted, the rest keep their rows
+  bool refit(int g) const { return refitted[g] != 0; }
+
+  // sums holds size() group sums per event, nevents events back to back
+  int passthreshold(const float*, int, unsigned char*) const;
+  void turnon(const float*, int, float*) const;
+
+  // Refit every pattern from a sample of group sums, see LogicParams.cpp
+  void fit(const std::vector<float>&, int, float nsigma = 2.5, int minentries = 20);
+};
+#endif
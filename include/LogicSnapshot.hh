@@ -0,0 +1,90 @@
+#ifndef LOGICSNAPSHOT_HH
+#define LOGICSNAPSHOT_HH
+
+#include "LogicBuilder.hh"
+#include <vector>
+#include <memory>
+
+// Module and node positions in the frame the logic is grown in. Made
+// once and shared unchanged by every snapshot.
+struct LogicModules {
+  std::vector<int> cells;        // ascending cell number
+  std::vector<float> x, y;
+  std::vector<float> nodex, nodey;
+};
+
+// One logic group: the node it grew from, its cells in ascending order
+struct LogicGroup {
+  int node;
+  std::vector<int> cells;
+};
+
+// An immutable logic layout: the chosen nodes, the excluded modules and
+// the groups grown from them. Every part is a shared_ptr to const data,
+// so a copy is O(1) and an edit returns a new snapshot that shares all
+// it did not change, down to single groups.
+class LogicSnapshot {
+
+public:
+  typedef std::shared_ptr<const LogicGroup> Group;
+
+private:
+  std::shared_ptr<const LogicModules> table;
+  std::shared_ptr<const std::vector<int> > nodeset, excluded;
+  std::shared_ptr<const std::vector<Group> > grouplist;
+  int maxcells;
+  float size;
+
+  Group find(int) const;
+  LogicSnapshot rebuild(LogicBuilder&, const std::shared_ptr<const std::vector<int> >&,
+			const std::shared_ptr<const std::vector<int> >&) const;
+
+public:
+  LogicSnapshot() : maxcells(0), size(0) {}
+  // maxcells and size as for LogicBuilder::build()
+  LogicSnapshot(const std::shared_ptr<const LogicModules>&, int, float);
+  ~LogicSnapshot() {};
+
+  // Edits, each returns the new layout and leaves this one alone.
+  // Node sets are indices into LogicModules::nodex/nodey.
+  LogicSnapshot withnodes(LogicBuilder&, const std::vector<int>&) const;
+  LogicSnapshot togglenode(LogicBuilder&, int) const;
+  LogicSnapshot togglecell(LogicBuilder&, int) const;
+
+  bool valid() const { return table != 0; }
+  bool same(const LogicSnapshot&) const;
+  int groups() const { return grouplist ? grouplist->size() : 0; }
+  const LogicGroup& group(int g) const { return *(*grouplist)[g]; }
+  const std::vector<int>& nodes() const { return *nodeset; }
+  const std::vector<int>& excludedcells() const { return *excluded; }
+  const LogicModules& modules() const { return *table; }
+
+  // Groups held by both snapshots, i.e. stored only once
+  int shared(const LogicSnapshot&) const;
+};
+
+// Undo and redo stacks plus one remembered layout to compare against.
+// Only snapshots are kept, so a step costs a few pointers on top of the
+// groups its edit changed.
+class LogicHistory {
+
+private:
+  LogicSnapshot now, other;
+  std::vector<LogicSnapshot> undos, redos;
+
+public:
+  LogicHistory() {};
+  ~LogicHistory() {};
+
+  void reset(const LogicSnapshot&);
+  bool edit(const LogicSnapshot&);   // false if nothing changed
+  bool undo();
+  bool redo();
+  void remember() { other = now; }
+  bool swap();                       // current and remembered, undoable
+
+  const LogicSnapshot& current() const { return now; }
+  const LogicSnapshot& remembered() const { return other; }
+  int steps() const { return undos.size(); }
+};
+#endif
@@ -0,0 +1,47 @@
+#ifndef LOGICTABLE_HH
+#define LOGICTABLE_HH
+
+#include "Layout.hh"
+#include <vector>
+#include <string>
+
+// Logic patterns as written by ECal::logicinfo(): one "#cell x y size"
+// row per module, patterns separated by a line of '#'. The pattern index
+// is the order of appearance in the file, starting at 0. Tools print and
+// read pattern numbers from 1, i.e. index + 1, like the CSV export.
+class LogicTable {
+
+private:
+  // The cells of pattern g are cells[ groupstart[g] ] ... cells[ groupstart[g+1]-1 ]
+  std::vector<int> groupstart;
+  std::vector<int> cells;
+  std::vector<int> moduleindex;
+  std::vector<float> xpos, ypos, sizes;
+
+public:
+  LogicTable() {};
+  ~LogicTable() {};
+
+  bool read(const std::string&);
+  bool bind(const Layout&);
+
+  int groups() const { return int(groupstart.size()) - 1; }
+  int entries() const { return cells.size(); }
+  const int* group(int g, int& n) const {
+    n = groupstart[g+1] - groupstart[g];
+    return &cells[0] + groupstart[g];
+  }
+  // Same layout as group(), but Layout module indices instead of cell numbers
+  const int* groupmodules(int g, int& n) const {
+    n = groupstart[g+1] - groupstart[g];
+    return &moduleindex[0] + groupstart[g];
+  }
+  float x(int entry) const { return xpos[entry]; }
+  float y(int entry) const { return ypos[entry]; }
+  float size(int entry) const { return sizes[entry]; }
+  int first(int g) const { return groupstart[g]; }
+
+  // Sum dense per-module energies into one value per pattern
+  void groupsums(const float*, float*) const;
+};
+#endif
@@ -0,0 +1,57 @@
+#ifndef PROFILER_HH
+#define PROFILER_HH
+
+#include <atomic>
+#include <string>
+#include <ostream>
+
+// Stage timers and counters. Each thread records into its own ring
+// buffer, so recording takes no lock. A ring is freed when its thread
+// exits, keeping only the records it held. Profiling is off by default
+// and a disabled PROFILE_SCOPE costs one relaxed load of the on/off flag.
+namespace Profiler {
+
+  extern std::atomic<bool> enabled;
+
+  inline bool on() { return enabled.load( std::memory_order_relaxed ); }
+  void enable(bool);
+
+  long long now();   // ns on a steady clock
+  void record(const char*, long long, long long);
+  void counter(const char*, long long);
+
+  // May run while other threads record. Records a thread overwrites
+  // during the copy are dropped; for a complete trace call while idle.
+  bool writetrace(const std::string&);
+  void summary(std::ostream&);
+  void clear();
+}
+
+class ProfileScope {
+
+private:
+  const char* name;
+  long long start;
+
+public:
+  explicit ProfileScope(const char* label) {
+    name = 0;
+    if( Profiler::on() ) {
+      name = label;
+      start = Profiler::now();
+    }
+  }
+  ~ProfileScope() { stop(); }
+
+  // End the scope early, for consecutive stages within one function
+  void stop() {
+    if( name ) Profiler::record( name, start, Profiler::now() );
+    name = 0;
+  }
+};
+
+#define PROFILE_CONCAT2(a,b) a##b
+#define PROFILE_CONCAT(a,b) PROFILE_CONCAT2(a,b)
+#define PROFILE_SCOPE(label) ProfileScope PROFILE_CONCAT(profilescope_,__LINE__)(label)
+#define PROFILE_COUNTER(label,value) if( Profiler::on() ) Profiler::counter(label,value)
+#endif
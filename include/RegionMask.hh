@@ -0,0 +1,51 @@
+#ifndef REGIONMASK_HH
+#define REGIONMASK_HH
+
+#include "Layout.hh"
+#include <vector>
+#include <string>
+
+// A set of ECal cells stored as a bitset over cell numbers. Regions are
+// built from simple rules evaluated against the module table and then
+// combined with set operations, e.g. the trigger efficiency crescent is
+//
+//   RegionMask::all(layout) - RegionMask::perimeter(layout,1) - RegionMask::list(layout,cells,n)
+//
+// The same can be written as text for parse(), see RegionMask.cpp.
+class RegionMask {
+
+private:
+  std::vector<unsigned long long> words;
+  int nbits;
+
+public:
+  RegionMask(int maxcell = 0);
+  ~RegionMask() {};
+
+  // Rules
+  static RegionMask all(const Layout&);
+  static RegionMask perimeter(const Layout&, int);
+  static RegionMask rows(const Layout&, int, int);
+  static RegionMask columns(const Layout&, int, int);
+  static RegionMask polygon(const Layout&, const std::vector<float>&, const std::vector<float>&);
+  static RegionMask list(const Layout&, const int*, int);
+  static bool parse(const Layout&, const std::string&, RegionMask&);
+
+  void set(int cell) { words[cell >> 6] |= 1ULL << (cell & 63); }
+  void reset(int cell) { words[cell >> 6] &= ~(1ULL << (cell & 63)); }
+  bool test(int cell) const {
+    return cell >= 0 && cell < nbits && ( words[cell >> 6] >> (cell & 63) & 1 );
+  }
+  int count() const;
+  void cells(std::vector<int>&) const;
+  bool write(const std::string&) const;
+
+  RegionMask& operator|=(const RegionMask&);
+  RegionMask& operator&=(const RegionMask&);
+  RegionMask& operator-=(const RegionMask&);
+  RegionMask operator|(const RegionMask& other) const { RegionMask r(*this); return r |= other; }
+  RegionMask operator&(const RegionMask& other) const { RegionMask r(*this); return r &= other; }
+  RegionMask operator-(const RegionMask& other) const { RegionMask r(*this); return r -= other; }
+  bool operator==(const RegionMask&) const;
+};
+#endif
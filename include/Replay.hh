@@ -0,0 +1,76 @@
+#ifndef REPLAY_HH
+#define REPLAY_HH
+
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "ECal.hh"
+#include "EventFile.hh"
+#include "LogicParams.hh"
+#include "LogicTable.hh"
+
+// Event display: module energies as a colour map on top of the ECal
+// geometry, with the logic patterns above threshold outlined by their
+// usual borders and every group sum written at its pattern's centre.
+//
+// Thresholds come from a parameter table and the logic file it was made
+// for: a viewer pattern takes the row of the pattern with the same
+// cells, patterns without a match use the given threshold.
+//
+// A loader thread reads the next event and turns it into module colours
+// and group sums while the current one is on screen (double buffering),
+// so advance() only swaps buffers and rewrites the vertex colours of one
+// preallocated quad array.
+class Replay : public sf::Drawable {
+
+private:
+  struct Frame {
+    int id;
+    float total;
+    std::vector<sf::Color> colors;   // per module
+    std::vector<float> sums;         // per logic pattern
+    std::vector<int> fired;
+  };
+
+  const ECal* ecal;
+  float emax;
+  std::vector<float> thresholds;
+
+  // Module and pattern lookups, all by Layout module index
+  std::vector<int> groupstart, groupmodules;
+  std::vector<sf::Color> palette;
+
+  sf::VertexArray heatmap;
+  Frame current, pending;
+  bool havepending, endoffile, stopping, loop;
+  long shown;
+
+  EventReader reader;
+  std::thread loader;
+  std::mutex lock;
+  std::condition_variable wake;
+
+  sf::Font font;
+  sf::Text status;
+  std::vector<sf::Text> sumtext;     // per logic pattern
+
+  void load();
+  void fill(const Event&, std::vector<float>&, Frame&) const;
+
+public:
+  Replay(const ECal&, float, float,
+	 const std::string& paramfile = "param_dontdelete.txt",
+	 const std::string& paramlogic = "full_logic_sept25.txt");
+  ~Replay();
+
+  bool open(const std::string&, bool repeat = true);
+  bool advance();
+  bool finished();
+
+  void draw(sf::RenderTarget&, sf::RenderStates) const;
+};
+#endif
@@ -0,0 +1,48 @@
+#ifndef SCRATCHARENA_HH
+#define SCRATCHARENA_HH
+
+#include <cstddef>
+#include <vector>
+
+// Bump allocator for short lived scratch arrays. Allocation moves a
+// pointer forward, release() and reset() move it back, nothing is freed
+// one by one. When a pass needs more than the current block an overflow
+// block is taken from the heap; the next reset() folds everything into
+// one block of the high-water size, so from then on the same pass runs
+// without touching the heap.
+//
+// Only for trivially constructible types, no constructors or destructors
+// are run.
+class ScratchArena {
+
+private:
+  char* block;
+  size_t capacity, used;
+  size_t highwater;
+  std::vector<char*> overflow;
+  size_t overflowbytes;
+  long heapblocks;
+
+  ScratchArena(const ScratchArena&);
+  ScratchArena& operator=(const ScratchArena&);
+
+  void* allocate(size_t, size_t);
+
+public:
+  explicit ScratchArena(size_t initial = 1 << 16);
+  ~ScratchArena();
+
+  template<class T>
+  T* array(size_t n) { return static_cast<T*>( allocate( n * sizeof(T), alignof(T) ) ); }
+
+  // Everything allocated after mark() goes away with release()
+  size_t mark() const { return used; }
+  void release(size_t position) { if( overflow.empty() ) used = position; }
+  void reset();
+
+  size_t size() const { return capacity; }
+  size_t peak() const { return highwater; }
+  // Blocks taken from the heap since construction
+  long blocks() const { return heapblocks; }
+};
+#endif
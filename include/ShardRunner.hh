@@ -0,0 +1,63 @@
+#ifndef SHARDRUNNER_HH
+#define SHARDRUNNER_HH
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <functional>
+
+// Anonymous shared memory for tables every worker reads. The parent
+// fills it before ShardRunner::run() and seals it read-only, the forked
+// workers then map the same pages instead of copies.
+class SharedSegment {
+
+private:
+  void* base;
+  size_t bytes;
+
+public:
+  SharedSegment() : base(0), bytes(0) {}
+  ~SharedSegment();
+
+  bool allocate(size_t);
+  bool seal();
+  void* data() const { return base; }
+  size_t size() const { return bytes; }
+};
+
+// Runs numbered shards in forked worker processes. A shard writes its
+// result to <dir>/shard_NNNNN.part, which is renamed to
+// <dir>/shard_NNNNN.txt once the worker exits cleanly. That file is the
+// checkpoint: a rerun skips finished shards, and a shard whose worker
+// crashed or failed is started again, up to the attempt limit. The job
+// parameters are kept in <dir>/manifest.txt, so checkpoints of a
+// different job are never taken for finished shards.
+class ShardRunner {
+
+private:
+  std::string dir;
+  int nshards, nworkers, maxattempts;
+  std::vector<int> attempts;
+
+  std::string partfile(int) const;
+
+public:
+  // work( shard, output ) runs in the child, false marks the shard failed
+  typedef std::function<bool(int, FILE*)> Work;
+
+  ShardRunner(const std::string&, int, int, int attempts = 3);
+  ~ShardRunner() {};
+
+  // Writes the manifest of a new job, or compares it with the one in
+  // the directory. False if they differ, or if there are shards but no
+  // manifest; the shards are then left alone.
+  bool manifest(const std::string&);
+  std::string shardfile(int) const;
+  bool done(int) const;
+  int remaining() const;
+
+  // Returns true when every shard has its checkpoint
+  bool run(const Work&);
+};
+#endif
@@ -0,0 +1,82 @@
+#ifndef SHOWERGENERATOR_HH
+#define SHOWERGENERATOR_HH
+
+#include "Layout.hh"
+#include "EventFile.hh"
+#include <vector>
+
+// xorshift128+ with LANES independent streams side by side. next()
+// advances all lanes at once in a loop the compiler vectorises, so
+// random numbers come in blocks of LANES.
+class ShowerRandom {
+
+public:
+  static const int LANES = 8;
+
+private:
+  unsigned long long s0[LANES], s1[LANES];
+  double block[LANES];
+  int used;
+  double spare;
+  bool havespare;
+
+  void refill();
+
+public:
+  ShowerRandom(unsigned long long seed = 1, unsigned long long stream = 0);
+
+  double uniform() {
+    if( used == LANES ) refill();
+    return block[ used++ ];
+  }
+  double gauss();
+};
+
+// Fast electromagnetic shower model. The lateral profile is a core and
+// a halo Gaussian, each separable in x and y, so the fraction landing in
+// a square block of any size (42, 40 or 38 mm) is a product of
+// differences of the tabulated cumulative profile. Energy is spread
+// over the modules within reach of the impact point and smeared with a
+// stochastic resolution term.
+class ShowerGenerator {
+
+private:
+  const Layout* layout;
+  ShowerRandom random;
+  double core, halo, corefraction;   // widths in mm, fraction in the core
+  double stochastic, constant;       // sigma/E = stochastic/sqrt(E[GeV]) + constant
+  double reach;                      // modules further than this get nothing (mm)
+  std::vector<double> corecdf, halocdf;
+  double tablestep, tablerange;
+  float minx, maxx, miny, maxy;
+
+  // Coarse grid over the layout, each bin lists the modules within reach
+  float binsize;
+  int nbinx, nbiny;
+  std::vector<int> binstart, binmodules;
+
+  double fraction(double, double, double) const;
+
+public:
+  ShowerGenerator(const Layout&, unsigned long long seed = 1, unsigned long long stream = 0);
+  ~ShowerGenerator() {};
+
+  void setprofile(double, double, double);
+  void setresolution(double, double);
+  // Restart the random numbers without rebuilding the module bins
+  void reseed(unsigned long long seed, unsigned long long stream) { random = ShowerRandom( seed, stream ); }
+
+  // Expected deposits without fluctuations, dense per module
+  void footprint(float, float, float, float*) const;
+  // Same, only the modules within reach: module indices and deposits,
+  // returns how many were written
+  int footprint(float, float, float, int*, float*) const;
+  // Upper bound on the modules one sparse footprint can write
+  int maxfootprint() const;
+  // One event, added to the dense per-module array and/or written to
+  // the event (either may be null). Returns the deposited energy.
+  float shower(float, float, float, float*, Event*);
+  // Impact point uniform over the layout
+  void randompoint(float&, float&);
+};
+#endif
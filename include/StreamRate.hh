@@ -0,0 +1,69 @@
+#ifndef STREAMRATE_HH
+#define STREAMRATE_HH
+
+#include "LogicTable.hh"
+#include "LogicParams.hh"
+#include <vector>
+#include <string>
+#include <ostream>
+
+// Streaming trigger rate and pileup estimate for time-stamped hits.
+//
+// Every logic pattern keeps a ring of nslices time slices, which together
+// form the coincidence window. A hit adds its energy to the slice it falls
+// in for every pattern containing its cell. A pattern triggers when the
+// window sum rises above its threshold; the trigger counts as accidental
+// if no single slice would have fired on its own, i.e. the threshold was
+// only reached by combining deposits from different times.
+//
+// Patterns are only moved forward in time when one of their cells is hit,
+// so the cost is per hit and the memory per pattern is fixed.
+class StreamRate {
+
+private:
+  const LogicTable* logic;
+  double slicewidth;
+  int nslices;
+  int ngroups;
+
+  // Patterns of a cell: cellgroups[ cellstart[cell] ] ... cellgroups[ cellstart[cell+1]-1 ]
+  std::vector<int> cellstart, cellgroups;
+
+  std::vector<float> threshold;
+  std::vector<float> ring;        // ngroups * nslices
+  std::vector<float> windowsum;
+  std::vector<long> lastslice;
+  std::vector<unsigned char> above;
+
+  std::vector<long> triggers, accidentals, pileups;
+  long nhits, nlate;
+  long newest;
+  double firsttime, lasttime;
+
+  // Online summary every interval ns of hit time
+  std::ostream* monitor;
+  double interval, nextemit;
+  long ntriggers, naccidentals;
+  long emittedhits, emittedtriggers, emittedaccidentals;
+
+  void advance(int, long);
+  void emit(double);
+
+public:
+  StreamRate(const LogicTable&, const LogicParams&, double, int);
+  ~StreamRate() {};
+
+  void addhit(int, float, double);
+  void reset();
+  // Print the rates of the last interval (ns) while hits come in, 0 stops
+  void online(std::ostream&, double);
+
+  long hits() const { return nhits; }
+  double elapsed() const { return nhits > 0 ? lasttime - firsttime : 0; }
+  long trigger(int g) const { return triggers[g]; }
+  long accidental(int g) const { return accidentals[g]; }
+  long pileup(int g) const { return pileups[g]; }
+
+  void report(std::ostream&) const;
+};
+#endif
@@ -0,0 +1,52 @@
+#ifndef TASKGRAPH_HH
+#define TASKGRAPH_HH
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Tasks with dependencies, run on a few worker threads. A task starts as
+// soon as every task it depends on has finished. The owner polls for
+// finished tasks, e.g. once per frame, so nothing has to block on them.
+// Everything a task wrote is visible to the thread that polled it.
+class TaskGraph {
+
+private:
+  struct Task {
+    std::string name;
+    std::function<void()> work;
+    std::vector<int> after;
+    bool started, finished;
+  };
+  std::vector<Task> tasks;
+  std::vector<std::thread> workers;
+  std::deque<int> reported;
+  int nstarted, nfinished;
+  mutable std::mutex lock;
+  std::condition_variable changed;
+
+  bool runnable(int) const;
+  void work();
+
+public:
+  TaskGraph() : nstarted(0), nfinished(0) {}
+  ~TaskGraph() { wait(); }
+
+  // Tasks can only depend on tasks added before them. No adding after start()
+  int add(const std::string&, const std::function<void()>&,
+	  const std::vector<int>& after = std::vector<int>());
+  void start(int);
+
+  bool poll(int&);        // next finished task not yet polled
+  bool done(int) const;
+  bool finished() const;
+  void wait();
+
+  int size() const { return tasks.size(); }
+  const std::string& name(int task) const { return tasks[task].name; }
+};
+#endif
@@ -0,0 +1,64 @@
+#ifndef WINDOWTRIGGER_HH
+#define WINDOWTRIGGER_HH
+
+#include "Layout.hh"
+#include <vector>
+
+// Trigger on every window of width x height modules instead of the fixed
+// logic patterns, the same 4 x 8 shape ECal::triggerlogic() allows.
+//
+// The layout is mapped to a row-band grid: grid row = layout row, grid
+// column = module position in half-module steps from x = 0, the same
+// column for every size band. Neighbouring rows are staggered by half a
+// module, so a window 2*width grid columns wide holds exactly width
+// modules of every row. Rows of different module sizes only line up at
+// x = 0, a half-module step is 21, 20 or 19 mm, so a window spanning
+// two size bands is sheared by up to a module at the edges. Such
+// windows are kept apart and counted on their own. Per event the
+// module energies are scattered into the grid, a summed-area table is
+// built and every window sum is four table reads. Both the table rows
+// and the window rows are plain loops over columns that gcc vectorises.
+class WindowTrigger {
+
+private:
+  const Layout* layout;
+  int nrows, ncols;            // grid
+  int wrows, wcols;            // window, in grid units
+  int nwinrows, nwincols;      // window positions
+  std::vector<int> gridindex;  // module -> grid cell
+  std::vector<float> grid;
+  std::vector<float> table;    // (nrows+1) x (ncols+1)
+  std::vector<float> sums;     // nwinrows x nwincols
+  std::vector<float> live;     // 1 for windows holding enough modules, else 0
+  std::vector<float> straddle; // the same for windows spanning size bands
+  std::vector<float> centerx, centery;
+  int nlive, nstraddling;
+
+
+public:
+  WindowTrigger(const Layout&, int width = 4, int height = 8, int minmodules = 16);
+  ~WindowTrigger() {};
+
+  // Every position, live or not; window w is at grid row w / windowcolumns().
+  // Live windows lie within one size band, straddling ones span two.
+  int windows() const { return nwinrows * nwincols; }
+  int windowcolumns() const { return nwincols; }
+  int livewindows() const { return nlive; }
+  int straddlingwindows() const { return nstraddling; }
+  bool islive(int w) const { return live[w] > 0; }
+  bool isstraddling(int w) const { return straddle[w] > 0; }
+  float x(int w) const { return centerx[w]; }
+  float y(int w) const { return centery[w]; }
+
+  // Dense energies indexed like Layout::module()
+  void process(const float*);
+  float sum(int w) const { return sums[w]; }
+  const float* windowsums() const { return &sums[0]; }
+
+  // Live windows over the threshold after process(); the straddling
+  // ones over it are counted in the same pass when asked for
+  int passthreshold(float, int* straddling = 0) const;
+  // Live window with the largest sum, -1 if there is none
+  int maxwindow() const;
+};
+#endif
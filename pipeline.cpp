@@ -0,0 +1,72 @@
+// Event study through the staged pipeline.
+//
+// usage: pipeline <events|-> [decode threads] [cluster threads] [trigger threads] [histogram threads] [depth] [histograms]
+//
+// Events are in the EventFile text format, e.g. written by shower_gen.
+// Prints the per-stage throughput and a short summary. The histograms
+// are written to the last argument if given, in binary when the name
+// ends in .bin and as text otherwise ("-" for stdout). hist_merge sums
+// binary files of several runs.
+#include <iostream>
+#include <cstdlib>
+#include <string>
+
+#include "include/Layout.hh"
+#include "include/LogicTable.hh"
+#include "include/LogicParams.hh"
+#include "include/EventFile.hh"
+#include "include/EventPipeline.hh"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  if( argc < 2 ) {
+    cerr << "usage: pipeline <events|-> [decode threads] [cluster threads] [trigger threads] [histogram threads] [depth] [histograms]" << endl;
+    return 1;
+  }
+  string eventfile = argv[1];
+  int depth = (argc > 6) ? atoi(argv[6]) : 256;
+  string histfile = (argc > 7) ? argv[7] : "";
+
+  Layout layout;
+  LogicTable logic;
+  LogicParams params;
+  if( !layout.read( "ecal_layout.txt" ) ) return 1;
+  if( !logic.read( "full_logic_sept25.txt" ) || !logic.bind( layout ) ) return 1;
+  if( !params.read( "param_dontdelete.txt", logic.groups() ) ) return 1;
+
+  EventReader reader;
+  if( !reader.open( eventfile ) ) return 1;
+
+  EventPipeline pipeline( layout, logic, params, depth );
+  if( argc > 2 ) pipeline.setthreads( EventPipeline::kDecode, atoi(argv[2]) );
+  if( argc > 3 ) pipeline.setthreads( EventPipeline::kCluster, atoi(argv[3]) );
+  if( argc > 4 ) pipeline.setthreads( EventPipeline::kTrigger, atoi(argv[4]) );
+  if( argc > 5 ) pipeline.setthreads( EventPipeline::kHistogram, atoi(argv[5]) );
+  pipeline.run( reader );
+  pipeline.report( cerr );
+
+  const HistogramSet& histograms = pipeline.results();
+  int clusters = histograms.find( "clusters" );
+  int nfired = histograms.find( "nfired" );
+  long events = histograms.entries( clusters, 0 );
+  double meanclusters = 0, meanfired = 0;
+  for( int bin=1; bin<=histograms.family(clusters).nbins; bin++ ) {
+    meanclusters += ( bin-1 ) * histograms.content( clusters, 0, bin );
+  }
+  for( int bin=1; bin<=histograms.family(nfired).nbins; bin++ ) {
+    meanfired += ( bin-1 ) * histograms.content( nfired, 0, bin );
+  }
+  if( events > 0 ) {
+    cerr << "clusters per event " << meanclusters / events
+	 << ", patterns fired per event " << meanfired / events << endl;
+  }
+
+  if( histfile.size() > 4 && histfile.compare( histfile.size()-4, 4, ".bin" ) == 0 ) {
+    if( !histograms.writebinary( histfile ) ) return 1;
+  }
+  else if( !histfile.empty() ) {
+    if( !histograms.writetext( histfile ) ) return 1;
+  }
+  return 0;
+}
@@ -1,68 +1,129 @@
+// Pattern lookups on a logic file.
+//
+// usage: read_logic [logic file] [queries|-]
+//
+// The index is kept next to the logic file as <logic file>.idx and
+// rebuilt whenever the logic file or ecal_layout.txt is newer. Without a
+// query file only the pattern and module counts are printed. Query lines
+// are
+//
+//   cell <cell number>       patterns containing the cell
+//   point <x mm> <y mm>      patterns containing the module under the point
+//   group <pattern>          cells of the pattern
+//   neighbors <pattern>      patterns sharing a cell with the pattern
+//
+// and each one gives exactly one output line, empty when nothing matches,
+// so the answers can be pasted back against the queries. Patterns are
+// numbered from 1 in the order of the logic file. Points are in the
+// coordinates of the logic file itself, not of ecal_layout.txt: the x y
+// columns written next to a cell find that cell.
 #include <iostream>
-#include <fstream>
-#include <set>
-#include <map>
-#include <vector>
-#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+
+#include "include/Layout.hh"
+#include "include/LogicTable.hh"
+#include "include/LogicIndex.hh"
 
 using namespace std;
 
-int main() {
-  ifstream logic;
-  logic.open("full_logic_sept25_copy.txt");
-  string line_temp;
-  int logic_number = 0;
-  vector<int> cell_values, x_values, y_values, size_values;
-  map<int,vector<int> > logic_cell, logic_x, logic_y, logic_size;
-  set<int> modulecount;
-  vector<int>::iterator vit;
-  map<int,vector<int> >::iterator mit;
+// Handle the index file, loaded if it is at least as new as the logic
+// file and the layout
+bool openindex(LogicIndex& index, const string& logicfile) {
+  string indexfile = logicfile + ".idx";
+  struct stat logicstat, layoutstat, indexstat;
+  if( stat( logicfile.c_str(), &logicstat ) != 0 ) {
+    cerr << "Error opening " << logicfile << endl;
+    return false;
+  }
+  if( stat( "ecal_layout.txt", &layoutstat ) != 0 ) {
+    cerr << "Error opening ecal_layout.txt" << endl;
+    return false;
+  }
+  if( stat( indexfile.c_str(), &indexstat ) == 0 && indexstat.st_mtime >= logicstat.st_mtime
+      && indexstat.st_mtime >= layoutstat.st_mtime ) {
+    if( index.load( indexfile ) ) return true;
+  }
+
+  Layout layout;
+  LogicTable logic;
+  if( !layout.read( "ecal_layout.txt" ) ) return false;
+  if( !logic.read( logicfile ) ) return false;
+  index.build( logic, layout );
+  index.save( indexfile );
+  return true;
+}
+
+// Pattern lists are printed with offset 1, cell lists with 0
+void printlist(const int* list, int n, int offset, char* out) {
+  char* p = out;
+  for( int k=0; k<n; k++ ) {
+    if( k > 0 ) *p++ = ' ';
+    p += sprintf( p, "%d", list[k] + offset );
+  }
+  *p++ = '\n';
+  *p = 0;
+  fputs( out, stdout );
+}
 
-  if( logic.is_open() ) {
-    while( getline(logic,line_temp) ) {
-      if( line_temp[0] == '#' ) {
-	logic_number++;
+int main(int argc, char** argv) {
+  string logicfile = (argc > 1) ? argv[1] : "full_logic_sept25_copy.txt";
+  LogicIndex index;
+  if( !openindex( index, logicfile ) ) return 1;
 
-	logic_cell[logic_number] = cell_values;
-	logic_x[logic_number] = x_values;
-	logic_y[logic_number] = y_values;
-	logic_size[logic_number] = size_values;
-	
-	// clear all the vectors so they can be inserted again
-	cell_values.clear();
-	x_values.clear();
-	y_values.clear();
-	size_values.clear();
-      }
-      if( line_temp[0] != '#' ) {
-	int cell, x, y, size;
-	stringstream first(line_temp);
-	first >> cell;
-	first >> x;
-	first >> y;
-	first >> size;
-	cell_values.push_back( cell );
-	x_values.push_back( x );
-	y_values.push_back( -1*y+40 );
-	size_values.push_back( size );
-	modulecount.insert( cell );
-      }
+  if( argc < 3 ) {
+    int modules = 0;
+    for( int cell=0; cell<=index.maxcell(); cell++ ) {
+      int n;
+      index.groupsofcell( cell, n );
+      if( n > 0 ) modules++;
     }
-    
-    logic.close();
+    cout << index.groups() << " patterns, " << modules << " modules" << endl;
+    return 0;
   }
-  else
-    cerr << "Error opening the text file" << endl;
-  
-  
-  // for( mit = logic_y.begin(); mit != logic_y.end(); mit++ ) {
-  //   cout << "log #: " << mit->first << endl;
-  //   for( vit = mit->second.begin(); vit != mit->second.end(); vit++ ){
-  //     cout << *vit << endl;   
-  //   }
-  // }
 
-  cout << modulecount.size() << endl;
+  string queryfile = argv[2];
+  FILE* in = ( queryfile == "-" ) ? stdin : fopen( queryfile.c_str(), "r" );
+  if( !in ) {
+    cerr << "Error opening " << queryfile << endl;
+    return 1;
+  }
 
+  static char outbuffer[1<<16];
+  setvbuf( stdout, outbuffer, _IOFBF, sizeof(outbuffer) );
+  // Longest answer is every pattern, at most 11 characters each
+  string line( 12*( index.groups() + index.maxcell() + 2 ), 0 );
+  char query[256];
+  while( fgets( query, sizeof(query), in ) ) {
+    char kind[16];
+    float x, y;
+    int value, n = 0, offset = 1;
+    const int* list = 0;
+    if( sscanf( query, "%15s", kind ) != 1 ) {
+      fputs( "\n", stdout );
+      continue;
+    }
+    if( strcmp( kind, "cell" ) == 0 && sscanf( query, "%*s %d", &value ) == 1 ) {
+      list = index.groupsofcell( value, n );
+    }
+    else if( strcmp( kind, "point" ) == 0 && sscanf( query, "%*s %f %f", &x, &y ) == 2 ) {
+      list = index.groupsatpoint( x, y, n );
+    }
+    else if( strcmp( kind, "group" ) == 0 && sscanf( query, "%*s %d", &value ) == 1 ) {
+      list = index.cells( value-1, n );
+      offset = 0;
+    }
+    else if( strcmp( kind, "neighbors" ) == 0 && sscanf( query, "%*s %d", &value ) == 1 ) {
+      list = index.neighbors( value-1, n );
+    }
+    else {
+      cerr << "Bad query: " << query;
+    }
+    printlist( list, n, offset, &line[0] );
+  }
+  if( in != stdin ) fclose( in );
+  fflush( stdout );
   return 0;
 }
@@ -0,0 +1,156 @@
+// Synthetic shower events on the ecal_layout.txt geometry.
+//
+// usage: shower_gen <nevents> [energy GeV] [threads] [output|-] [scan step mm]
+//
+// Impact points are random over the detector, or stepped over a grid
+// when a scan step is given. Without an output file only the rate is
+// measured. Events are generated in blocks of 1000 with one random
+// stream per block, so the output does not depend on the thread count.
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "include/Layout.hh"
+#include "include/EventFile.hh"
+#include "include/ShowerGenerator.hh"
+
+using namespace std;
+
+const int kBlock = 1000;
+
+int main(int argc, char** argv) {
+  if( argc < 2 ) {
+    cerr << "usage: shower_gen <nevents> [energy GeV] [threads] [output|-] [scan step mm]" << endl;
+    return 1;
+  }
+  long nevents = atol(argv[1]);
+  float energy = 1000 * ( (argc > 2) ? atof(argv[2]) : 3.0 );
+  int nthreads = (argc > 3) ? atoi(argv[3]) : thread::hardware_concurrency();
+  string output = (argc > 4) ? argv[4] : "-";
+  float step = (argc > 5) ? atof(argv[5]) : 0;
+  if( nthreads < 1 ) nthreads = 1;
+  if( nevents < 0 ) nevents = 0;
+
+  Layout layout;
+  if( !layout.read( "ecal_layout.txt" ) ) return 1;
+
+  // Scan points: grid nodes that fall on a module
+  vector<float> scanx, scany;
+  if( step > 0 ) {
+    float minx = 0, maxx = 0, miny = 0, maxy = 0;
+    for( int i=0; i<layout.size(); i++ ) {
+      const Module& mod = layout.module(i);
+      minx = (mod.x < minx) ? mod.x : minx;
+      maxx = (mod.x > maxx) ? mod.x : maxx;
+      miny = (mod.y < miny) ? mod.y : miny;
+      maxy = (mod.y > maxy) ? mod.y : maxy;
+    }
+    for( float y = miny; y <= maxy; y += step ) {
+      for( float x = minx; x <= maxx; x += step ) {
+	for( int i=0; i<layout.size(); i++ ) {
+	  const Module& mod = layout.module(i);
+	  if( fabs( mod.x - x ) < 0.5*mod.type && fabs( mod.y - y ) < 0.5*mod.type ) {
+	    scanx.push_back( x );
+	    scany.push_back( y );
+	    break;
+	  }
+	}
+      }
+    }
+    cerr << scanx.size() << " scan points" << endl;
+  }
+
+  EventWriter writer;
+  bool writing = ( output != "-" );
+  if( writing && !writer.open( output ) ) return 1;
+
+  // Threads fill chunks of events, the main thread writes them out.
+  // Two chunk buffers: the threads fill the next chunk while the last
+  // one is written. Each thread keeps one generator for the whole run,
+  // its tables take far longer to build than a chunk to fill.
+  long nblocks = ( nevents + kBlock - 1 ) / kBlock;
+  long chunkblocks = writing ? 4*nthreads : nblocks;
+  if( chunkblocks < 1 ) chunkblocks = 1;
+  long nchunks = ( nblocks + chunkblocks - 1 ) / chunkblocks;
+  vector<Event> chunk[2];
+  for( int b=0; b<2 && writing; b++ ) chunk[b].resize( chunkblocks*kBlock );
+  vector<double> sums( nthreads, 0 );
+  mutex lock;
+  condition_variable changed;
+  long released = writing ? 1 : 0;   // chunks the threads may fill
+  int filled[2] = { 0, 0 };          // threads done with each buffer
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  vector<thread> workers;
+  for( int t=0; t<nthreads; t++ ) {
+    workers.push_back( thread( [&, t]() {
+	  Event scratch;
+	  ShowerGenerator generator( layout );
+	  for( long c=0; c<nchunks; c++ ) {
+	    {
+	      unique_lock<mutex> guard( lock );
+	      changed.wait( guard, [&]() { return released >= c; } );
+	    }
+	    long first = c*chunkblocks;
+	    long last = ( first + chunkblocks < nblocks ) ? first + chunkblocks : nblocks;
+	    vector<Event>& events = chunk[c % 2];
+	    for( long block=first+t; block<last; block+=nthreads ) {
+	      generator.reseed( 12345, block );
+	      long end = ( (block+1)*kBlock < nevents ) ? (block+1)*kBlock : nevents;
+	      for( long ev=block*kBlock; ev<end; ev++ ) {
+		float x, y;
+		if( scanx.empty() ) {
+		  generator.randompoint( x, y );
+		}
+		else {
+		  x = scanx[ ev % scanx.size() ];
+		  y = scany[ ev % scany.size() ];
+		}
+		Event* event = writing ? &events[ ev - first*kBlock ] : &scratch;
+		event->id = ev;
+		sums[t] += generator.shower( x, y, energy, 0, event );
+	      }
+	    }
+	    lock_guard<mutex> guard( lock );
+	    filled[c % 2]++;
+	    changed.notify_all();
+	  }
+	} ) );
+  }
+
+  for( long c=0; c<nchunks && writing; c++ ) {
+    {
+      unique_lock<mutex> guard( lock );
+      changed.wait( guard, [&]() { return filled[c % 2] == nthreads; } );
+    }
+    long first = c*chunkblocks;
+    long last = ( first + chunkblocks < nblocks ) ? first + chunkblocks : nblocks;
+    long end = ( last*kBlock < nevents ) ? last*kBlock : nevents;
+    for( long ev=first*kBlock; ev<end; ev++ ) writer.write( chunk[c % 2][ ev - first*kBlock ] );
+
+    // The buffer is free again for the chunk after the next
+    lock_guard<mutex> guard( lock );
+    filled[c % 2] = 0;
+    released = c + 2;
+    changed.notify_all();
+  }
+  for( int t=0; t<nthreads; t++ ) workers[t].join();
+  double seconds = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+  double total = 0;
+  for( int t=0; t<nthreads; t++ ) total += sums[t];
+  cerr << nevents << " events in " << seconds << " s";
+  if( nevents == 0 ) {
+    cerr << endl;
+    return 0;
+  }
+  cerr << ", " << nevents/seconds << " events/s, "
+       << "mean energy " << total/nevents << " MeV" << endl;
+  return 0;
+}
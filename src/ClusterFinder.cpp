@@ -0,0 +1,137 @@
+#include "../include/ClusterFinder.hh"
+#include <algorithm>
+#include <thread>
+
+namespace {
+  // Order seeds by decreasing energy, ties by module index
+  struct SeedOrder {
+    const float* energy;
+    bool operator()(int a, int b) const {
+      if( energy[a] != energy[b] ) return energy[a] > energy[b];
+      return a < b;
+    }
+  };
+}
+
+ClusterFinder::ClusterFinder(const Layout& table, float seed, float cell, int rings) {
+  layout = &table;
+  seedcut = seed;
+  cellcut = cell;
+  nrings = rings;
+
+  int n = layout->size();
+  seeds.reserve( n );
+  touched.reserve( n );
+  ring.reserve( n );
+  nextring.reserve( n );
+  owner.assign( n, -1 );
+}
+
+int ClusterFinder::findclusters(const float* energy, std::vector<Cluster>& clusters) {
+  clusters.clear();
+  seeds.clear();
+
+  // Seeds are local maxima above the seed threshold
+  int n = layout->size();
+  for( int i=0; i<n; i++ ) {
+    if( energy[i] <= seedcut ) continue;
+    int nn;
+    const int* nb = layout->neighbors( i, nn );
+    bool maximum = true;
+    for( int k=0; k<nn && maximum; k++ ) {
+      int j = nb[k];
+      if( energy[j] > energy[i] || ( energy[j] == energy[i] && j < i ) ) {
+	maximum = false;
+      }
+    }
+    if( maximum ) seeds.push_back( i );
+  }
+  SeedOrder order;
+  order.energy = energy;
+  std::sort( seeds.begin(), seeds.end(), order );
+
+  // Grow each seed ring by ring. A cell only joins through a neighbour
+  // with at least its own energy, which keeps nearby showers apart.
+  for( int s=0; s<int(seeds.size()); s++ ) {
+    int seed = seeds[s];
+    if( owner[seed] != -1 ) continue;
+
+    int id = clusters.size();
+    Cluster clust;
+    clust.seed = seed;
+    clust.ncells = 1;
+    clust.energy = energy[seed];
+    float sumx = energy[seed] * layout->module(seed).x;
+    float sumy = energy[seed] * layout->module(seed).y;
+    owner[seed] = id;
+    touched.push_back( seed );
+
+    ring.clear();
+    ring.push_back( seed );
+    for( int r=0; r<nrings && !ring.empty(); r++ ) {
+      nextring.clear();
+      for( int c=0; c<int(ring.size()); c++ ) {
+	int cell = ring[c];
+	int nn;
+	const int* nb = layout->neighbors( cell, nn );
+	for( int k=0; k<nn; k++ ) {
+	  int j = nb[k];
+	  if( owner[j] != -1 || energy[j] <= cellcut || energy[j] > energy[cell] ) continue;
+	  owner[j] = id;
+	  touched.push_back( j );
+	  nextring.push_back( j );
+	  clust.ncells++;
+	  clust.energy += energy[j];
+	  sumx += energy[j] * layout->module(j).x;
+	  sumy += energy[j] * layout->module(j).y;
+	}
+      }
+      ring.swap( nextring );
+    }
+
+    clust.x = sumx / clust.energy;
+    clust.y = sumy / clust.energy;
+    clusters.push_back( clust );
+  }
+
+  // Only reset what this event used
+  for( int t=0; t<int(touched.size()); t++ ) {
+    owner[ touched[t] ] = -1;
+  }
+  touched.clear();
+
+  return clusters.size();
+}
+
+ClusterBatch::ClusterBatch(const Layout& table, float seed, float cell, int nthreads) {
+  stride = table.size();
+  if( nthreads < 1 ) nthreads = 1;
+  for( int t=0; t<nthreads; t++ ) {
+    finders.push_back( ClusterFinder( table, seed, cell ) );
+  }
+}
+
+void ClusterBatch::process(const std::vector<float>& energies,
+			   std::vector<std::vector<Cluster> >& clusters) {
+  int nevents = energies.size() / stride;
+  clusters.resize( nevents );
+
+  // Contiguous event ranges per thread, each with its own finder
+  int nthreads = finders.size();
+  std::vector<std::thread> workers;
+  for( int t=0; t<nthreads; t++ ) {
+    int first = ( long(nevents) * t ) / nthreads;
+    int last  = ( long(nevents) * (t+1) ) / nthreads;
+    ClusterFinder* finder = &finders[t];
+    const float* data = energies.empty() ? 0 : &energies[0];
+    int width = stride;
+    workers.push_back( std::thread( [=, &clusters]() {
+	  for( int ev=first; ev<last; ev++ ) {
+	    finder->findclusters( data + long(ev)*width, clusters[ev] );
+	  }
+	} ) );
+  }
+  for( int t=0; t<nthreads; t++ ) {
+    workers[t].join();
+  }
+}
@@ -0,0 +1,224 @@
+#include "../include/CoverageMap.hh"
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+CoverageMap::CoverageMap(const Layout& table, float pixelsize) {
+  layout = &table;
+  pixel = pixelsize > 0 ? pixelsize : 1.0;
+
+  float minx = 0, maxx = 0, miny = 0, maxy = 0;
+  for( int i=0; i<layout->size(); i++ ) {
+    const Module& mod = layout->module(i);
+    float half = 0.5*mod.type;
+    minx = std::min( minx, mod.x - half );
+    maxx = std::max( maxx, mod.x + half );
+    miny = std::min( miny, mod.y - half );
+    maxy = std::max( maxy, mod.y + half );
+  }
+  // One pixel of margin on every side
+  x0 = minx - pixel;
+  y0 = miny - pixel;
+  width = int( ceil( (maxx - x0) / pixel ) ) + 1;
+  height = int( ceil( (maxy - y0) / pixel ) ) + 1;
+  words = ( width + 63 ) / 64;
+
+  long n = long(height) * words;
+  glass.assign( n, 0 );
+  envelope.assign( n, 0 );
+  scratch.assign( n, 0 );
+  planes.assign( (kPlanes+1) * n, 0 );
+  ngroups = 0;
+
+  for( int i=0; i<layout->size(); i++ ) {
+    int i0, i1, j0, j1;
+    if( !pixels( i, i0, i1, j0, j1 ) ) continue;
+    for( int j=j0; j<j1; j++ ) span( &glass[0] + long(j)*words, i0, i1 );
+  }
+
+  // Handle the envelope, row by row between the outermost glass pixels
+  for( int j=0; j<height; j++ ) {
+    const uint64_t* row = &glass[0] + long(j)*words;
+    int first = -1, last = -1;
+    for( int w=0; w<words; w++ ) {
+      if( !row[w] ) continue;
+      if( first < 0 ) first = 64*w + __builtin_ctzll( row[w] );
+      last = 64*w + 63 - __builtin_clzll( row[w] );
+    }
+    if( first >= 0 ) span( &envelope[0] + long(j)*words, first, last+1 );
+  }
+  region = glass;
+}
+
+bool CoverageMap::pixels(int i, int& i0, int& i1, int& j0, int& j1) const {
+  // Pixels whose centre is strictly inside the module
+  const Module& mod = layout->module(i);
+  float half = 0.5*mod.type;
+  i0 = int( floor( (mod.x - half - x0) / pixel - 0.5 ) ) + 1;
+  i1 = int( ceil( (mod.x + half - x0) / pixel - 0.5 ) );
+  j0 = int( floor( (mod.y - half - y0) / pixel - 0.5 ) ) + 1;
+  j1 = int( ceil( (mod.y + half - y0) / pixel - 0.5 ) );
+  i0 = std::max( i0, 0 );
+  j0 = std::max( j0, 0 );
+  i1 = std::min( i1, width );
+  j1 = std::min( j1, height );
+  return i0 < i1 && j0 < j1;
+}
+
+void CoverageMap::span(uint64_t* row, int i0, int i1) const {
+  // Sets bits i0 ... i1-1 of a pixel row
+  int w0 = i0 >> 6, w1 = (i1-1) >> 6;
+  uint64_t first = ~0ULL << (i0 & 63);
+  uint64_t last = ~0ULL >> ( 63 - ((i1-1) & 63) );
+  if( w0 == w1 ) {
+    row[w0] |= first & last;
+    return;
+  }
+  row[w0] |= first;
+  for( int w=w0+1; w<w1; w++ ) row[w] = ~0ULL;
+  row[w1] |= last;
+}
+
+void CoverageMap::setregion(const RegionMask& mask) {
+  std::fill( region.begin(), region.end(), 0 );
+  for( int i=0; i<layout->size(); i++ ) {
+    int i0, i1, j0, j1;
+    if( !mask.test( layout->module(i).cell ) || !pixels( i, i0, i1, j0, j1 ) ) continue;
+    for( int j=j0; j<j1; j++ ) span( &region[0] + long(j)*words, i0, i1 );
+  }
+}
+
+void CoverageMap::clear() {
+  std::fill( planes.begin(), planes.end(), 0 );
+  ngroups = 0;
+}
+
+void CoverageMap::addgroup(const int* modules, int n) {
+  // Rasterise the pattern first, so modules sharing a boundary pixel
+  // still count the pattern once
+  int rowlo = height, rowhi = 0;
+  for( int k=0; k<n; k++ ) {
+    int i0, i1, j0, j1;
+    if( modules[k] < 0 || !pixels( modules[k], i0, i1, j0, j1 ) ) continue;
+    for( int j=j0; j<j1; j++ ) span( &scratch[0] + long(j)*words, i0, i1 );
+    rowlo = std::min( rowlo, j0 );
+    rowhi = std::max( rowhi, j1 );
+  }
+
+  // Ripple the pattern bitmap through the planes, the carry out of the
+  // top plane marks saturated pixels
+  long begin = long(rowlo) * words;
+  long end = long(rowhi) * words;
+  uint64_t* saturated = plane( kPlanes );
+  for( long w=begin; w<end; w++ ) {
+    uint64_t carry = scratch[w];
+    for( int k=0; k<kPlanes; k++ ) {
+      uint64_t* p = plane(k) + w;
+      uint64_t next = *p & carry;
+      *p ^= carry;
+      carry = next;
+    }
+    saturated[w] |= carry;
+    scratch[w] = 0;
+  }
+  ngroups++;
+}
+
+void CoverageMap::addlogic(const LogicTable& logic) {
+  for( int g=0; g<logic.groups(); g++ ) {
+    int n;
+    const int* modules = logic.groupmodules( g, n );
+    addgroup( modules, n );
+  }
+}
+
+long CoverageMap::glassarea() const {
+  long sum = 0;
+  for( size_t w=0; w<glass.size(); w++ ) sum += __builtin_popcountll( glass[w] );
+  return sum;
+}
+
+long CoverageMap::gaparea() const {
+  long sum = 0;
+  for( size_t w=0; w<glass.size(); w++ ) sum += __builtin_popcountll( envelope[w] & ~glass[w] );
+  return sum;
+}
+
+long CoverageMap::regionarea() const {
+  long sum = 0;
+  for( size_t w=0; w<region.size(); w++ ) sum += __builtin_popcountll( region[w] );
+  return sum;
+}
+
+void CoverageMap::multiplicity(std::vector<long>& counts) const {
+  int top = ( 1 << kPlanes ) - 1;
+  counts.assign( top+1, 0 );
+  long n = long(height) * words;
+  const uint64_t* saturated = plane( kPlanes );
+  for( int m=0; m<=top; m++ ) {
+    // Pixels whose planes spell m; the top value also takes the saturated ones
+    long sum = 0;
+    for( long w=0; w<n; w++ ) {
+      uint64_t match = region[w];
+      for( int k=0; k<kPlanes; k++ ) {
+	uint64_t bits = plane(k)[w];
+	match &= ( m >> k & 1 ) ? bits : ~bits;
+      }
+      if( m == top ) match |= region[w] & saturated[w];
+      else match &= ~saturated[w];
+      sum += __builtin_popcountll( match );
+    }
+    counts[m] = sum;
+  }
+}
+
+void CoverageMap::report(std::ostream& out) const {
+  double area = pixel * pixel * 1e-2;    // cm^2 per pixel
+  long total = regionarea();
+  std::vector<long> counts;
+  multiplicity( counts );
+  out << ngroups << " patterns on a " << width << " x " << height << " grid of "
+      << pixel << " mm pixels" << std::endl;
+  out << "glass " << glassarea() * area << " cm2, gaps between modules " << gaparea() * area
+      << " cm2, region " << total * area << " cm2" << std::endl;
+  for( size_t m=0; m<counts.size(); m++ ) {
+    out << std::setw(3) << m << ( m+1 == counts.size() ? "+" : " " ) << " patterns "
+	<< std::setw(10) << counts[m] * area << " cm2  "
+	<< std::fixed << std::setprecision(2) << std::setw(6)
+	<< ( total ? 100.0 * counts[m] / total : 0 ) << "%" << std::endl;
+    out.unsetf( std::ios::fixed );
+    out << std::setprecision(6);
+  }
+}
+
+bool CoverageMap::writepgm(const std::string& filename) const {
+  FILE* out = fopen( filename.c_str(), "wb" );
+  if( !out ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  fprintf( out, "P5\n%d %d\n255\n", width, height );
+  std::vector<unsigned char> row( width );
+  // Top of the image is the top of the detector
+  for( int j=height-1; j>=0; j-- ) {
+    long base = long(j) * words;
+    for( int i=0; i<width; i++ ) {
+      long w = base + (i >> 6);
+      uint64_t bit = 1ULL << (i & 63);
+      int value;
+      if( !( glass[w] & bit ) ) value = ( envelope[w] & bit ) ? 60 : 0;
+      else {
+	int m = 0;
+	for( int k=0; k<kPlanes; k++ ) if( plane(k)[w] & bit ) m |= 1 << k;
+	if( plane( kPlanes )[w] & bit ) m = ( 1 << kPlanes ) - 1;
+	value = 255 - 20*m;
+      }
+      row[i] = value;
+    }
+    fwrite( &row[0], 1, width, out );
+  }
+  fclose( out );
+  return true;
+}
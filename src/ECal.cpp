@@ -1,4 +1,6 @@
 #include "../include/ECal.hh"
+#include "../include/Profiler.hh"
+#include "../include/LogicExport.hh"
 #include <string>
 #include <sstream>
 #include <fstream>
@@ -8,6 +10,8 @@
 #include <algorithm>
 #include <iomanip>
 
+// std::next is only available from C++11 on
+#if __cplusplus < 201103L
 template <typename ForwardIt>
 ForwardIt next(ForwardIt it, 
                typename std::iterator_traits<ForwardIt>::difference_type n = 1)
@@ -15,6 +19,7 @@ ForwardIt next(ForwardIt it,
   std::advance(it, n);
   return it;
 }
+#endif
 
 ECal::ECal(float x, float y){
   displayx = x;
@@ -61,16 +66,14 @@ ECal::ECal(float x, float y){
   module38.setOutlineColor( sf::Color::Black ); 
 
   // Make Generic Node
+  // The group shape that goes with maxclustersize (search box, cells per
+  // row, rows) is fixed at compile time, see LogicKernel.hh
   maxclustersize = 32;
   increment = 80; 
   incrementy = 160;
-  if( maxclustersize == 32 ) {
-    clustercutx = 2.1;
-    clustercuty = 4.1;
-  }
-  if( maxclustersize == 64 ) {
-    clustercutx = 4.1;
-    clustercuty = 4.1;
+  if( maxclustersize != 32 && maxclustersize != 64 ) {
+    std::cerr << "No logic kernel for " << maxclustersize << " modules, using 32." << std::endl;
+    maxclustersize = 32;
   }
   nodeR = 5.0;
   node.setRadius( nodeR );
@@ -118,97 +121,61 @@ ECal::ECal(float x, float y){
   boardercolors.push_back( green_sfml );
   boardercolors.push_back( magenta_sfml );
 
-  // Handle text indices on nodes
-  if( !font.loadFromFile("fonts/arial.ttf")) {
-    std::cerr << "ERROR: Font did not load properly." << std::endl;
-  }
-  textind.setFont(font);
-  textind.setCharacterSize( 15 );
-  textind.setColor( sf::Color::Black );
-
   // Handle boarders
   lines = sf::VertexArray(sf::LinesStrip,2);
 
   // Handle keyboard input
-  time = 0.0;
   logboarders = false;
   logcolors = false;
-  control = false;
   crescent = false;
   indexthenodes = false;
   indexthemods = false;
-  count1 = 0;
-  count2 = 0;
-  count3 = 0;
-  count4 = 0;
-  count5 = 0;
+
+  // Layers are rendered on the first draw, only the modules are ready
+  layerscached = false;
+  for( int l=0; l<kLayers; l++ ) {
+    layerdirty[l] = true;
+    layertask[l] = -1;
+    layerready[l] = (l == kModules);
+  }
+  polledtasks = 0;
+}
+
+void ECal::loadfont() {
+  // Handle text indices on nodes
+  if( !font.loadFromFile("fonts/arial.ttf")) {
+    std::cerr << "ERROR: Font did not load properly." << std::endl;
+  }
+  textind.setFont(font);
+  textind.setCharacterSize( 15 );
+  textind.setColor( sf::Color::Black );
 }
 
+// Cells cut from the trigger efficiency crescent on top of the outer ring
+static const int TEexcluded[] = {
+  1728, 1737, 1738, 1739, 1740,
+  1677, // Might need to be removed.
+  1678, 1679, 1680, 1681,
+  /* 1601, */ 1602, 1603, 1604, 1605,
+  /* 1511, */ 1512, 1513,
+  /* 1409, */ 1410, 1411, 1412, 1413,
+  1184, 1185, 1180, 1181, 1011, 1068, 1069,
+  635, 578, 527, 360, 361, 362, 266, 179, 180,
+  103, 104, 105, 43, 44, 45, 34, 35
+};
+
 void ECal::initializeECal() {
-  std::ifstream layout;
-  layout.open("ecal_layout.txt");
-  std::string line;
+  PROFILE_SCOPE("initializeECal");
+  ProfileScope parsing("initializeECal: layout");
   float yoffset = 40.0;
 
-  // Trigger Efficiency Calorimeter Shape
-  // we need to exclude the perimeter modules
-  std::set<int>  cellnumberTE;
-  std::set<int>::iterator vit;
-  std::set<int> TEcells;
-  TEcells.insert( 1728 );
-  TEcells.insert( 1737 );
-  TEcells.insert( 1738 );
-  TEcells.insert( 1739 );
-  TEcells.insert( 1740 );
-  TEcells.insert( 1677 ); // Might need to be removed.
-  TEcells.insert( 1678 );
-  TEcells.insert( 1679 );
-  TEcells.insert( 1680 );
-  TEcells.insert( 1681 );
-  //TEcells.insert( 1601 );
-  TEcells.insert( 1602 );
-  TEcells.insert( 1603 );
-  TEcells.insert( 1604 );
-  TEcells.insert( 1605 );
-  //TEcells.insert( 1511 );
-  TEcells.insert( 1512 );
-  TEcells.insert( 1513 );
-  //TEcells.insert( 1409 );
-  TEcells.insert( 1410 );
-  TEcells.insert( 1411 );
-  TEcells.insert( 1412 );
-  TEcells.insert( 1413 );
-  TEcells.insert( 1184 );
-  TEcells.insert( 1185 );
-  TEcells.insert( 1180 );
-  TEcells.insert( 1181 );
-  TEcells.insert( 1011 );
-  TEcells.insert( 1068 );
-  TEcells.insert( 1069 );
-  TEcells.insert( 635 );
-  TEcells.insert( 578 );
-  TEcells.insert( 527 );
-  TEcells.insert( 360 );
-  TEcells.insert( 361 );
-  TEcells.insert( 362 );
-  TEcells.insert( 266 );
-  TEcells.insert( 179 );
-  TEcells.insert( 180 );
-  TEcells.insert( 103 );
-  TEcells.insert( 104 );
-  TEcells.insert( 105 );
-  TEcells.insert( 43 );
-  TEcells.insert( 44 );
-  TEcells.insert( 45 );
-  TEcells.insert( 34 );
-  TEcells.insert( 35 );
-
-
-  if( layout.is_open() ) {
-    while( std::getline( layout, line) && line[0]!='#') {}    
-    
-    int type, cell, row, col, x, y, ncol;
-    while( layout >> type >> cell >> row >> col >> x >> y >> ncol ){
+  if( table.read("ecal_layout.txt") ) {
+    for( int i=0; i<table.size(); i++ ) {
+      const Module& mod = table.module(i);
+      int type = mod.type;
+      int cell = mod.cell;
+      int x = int(mod.x);
+      int y = int(mod.y);
       y *= -1;
       y += yoffset;
       sf::Vector2f cellposition( 0.5*displayx + float(x), 0.5*displayy + float(y) );
@@ -218,27 +185,6 @@ void ECal::initializeECal() {
       maxy = (y > maxy) ? y : maxy;
       miny = (y < miny) ? y : miny;  
 
-      // Work on defining TE ECal crescent shape (exclude perimeter modules)
-      // I will take advantage of row/col & ncols. If row or col = 1, then 
-      // it can be ignored. Also, if col = ncol, then it can be ignored as well
-      bool found = false;
-      if( row != 1 ) {
-	if( col != 1 ) { 
-	  if( col != ncol ) {
-	    if( row != 80 ) {
-	      for(vit = TEcells.begin(); vit != TEcells.end(); vit++ ) {
-		if( *vit == cell ) {
-		  found = true;
-		}
-	      }
-	      if( !found ) {
-		cellnumberTE.insert( cell );
-	      }
-	    }
-	  }
-	}
-      }
-
       if( type == 42 ) {
 	module42.setPosition( cellposition );
 	modules.push_back( module42 );
@@ -261,29 +207,22 @@ void ECal::initializeECal() {
 	count38++;
       } 
     }
-    layout.close();
-  }
-  else {
-    std::cerr << "Error opening ecal_layout.txt" << std::endl;
   }
+  parsing.stop();
   ecalminy = miny;
   ecalmaxy = maxy;
   ecalminx = minx;
   ecalmaxx = maxx;
 
-  // Output of Trigger Efficiency Layout
-  std::ofstream output("TE_layout_oct13.txt");
-  if(output.is_open() ) {
-    for(vit = cellnumberTE.begin(); vit != cellnumberTE.end(); vit++ ) {
-      for( mapit = modmap.begin(); mapit != modmap.end(); mapit++ ) {
-  	if( *vit == mapit->first ) {
-  	  //mapit->second.setFillColor( sf::Color::Blue );
-  	}
-      }
-      output << *vit << std::endl;
-    }
-  }
-  output.close();
+  // Trigger Efficiency Calorimeter Shape: everything but the outer ring
+  // of modules (first/last row and column) and a list of single cells
+  ProfileScope region("initializeECal: TE region");
+  int nexcluded = sizeof(TEexcluded) / sizeof(TEexcluded[0]);
+  TEregion = RegionMask::all( table )
+    - RegionMask::perimeter( table, 1 )
+    - RegionMask::list( table, TEexcluded, nexcluded );
+
+  region.stop();
 
   // Make transparent rectangle that boarders ECal
   float xmoduleoffset = (38 + 40) / 2.0;
@@ -299,6 +238,7 @@ void ECal::initializeECal() {
   boarder.setPosition( boarderPos );
 
   // Make nodes, excluding the perimeter
+  PROFILE_SCOPE("initializeECal: nodes");
   sf::Vector2f boarderCenter = boarder.getPosition();
   sf::Vector2f boarderSize(0.5*boarder.getSize().x, 0.5*boarder.getSize().y);
 
@@ -345,6 +285,8 @@ void ECal::initializeECal() {
 }  
 
 void ECal::triggerlogic() {
+  PROFILE_SCOPE("triggerlogic");
+  long long added = 0;
   // LOGIC GROUPS WITH LESS THAN 32 MODULES
   /////////////////////////////////////////
   std::ifstream bad_logic;
@@ -366,122 +308,109 @@ void ECal::triggerlogic() {
   bad_logic.close();
   ///////////////////////////////////////////
 
+  // Module and node positions for the logic kernels, shared by every
+  // snapshot of the layout made while editing
+  std::shared_ptr<LogicModules> positions = std::make_shared<LogicModules>();
+  for( mapit = modmap.begin(); mapit != modmap.end(); mapit++ ) {
+    positions->cells.push_back( mapit->first );
+    positions->x.push_back( mapit->second.getPosition().x );
+    positions->y.push_back( mapit->second.getPosition().y );
+  }
+  std::vector<int> chosen;
+
   for( int i=0; i<nodes.size(); i++ ) {
+    positions->nodex.push_back( nodes[i].getPosition().x );
+    positions->nodey.push_back( nodes[i].getPosition().y );
     // for( int i=150; i<151; i++ ) {
     if( i==20 || i==31  || i==43  || i==57  || i==71  || i==85  ||
     	i==98 || i==111 || i==124 || i==137 || i==151 || i==165 ||
     	i==179 || i ==191 || i==202 || i==211 ) {
     //if( i==1000 ) {
-      sf::Vector2f nodetemp = nodes[i].getPosition();
-      sf::Vector2f centerlogic(0,0);
-      sf::Vector2f neighbors(0,0);
-      int n = 0;
-      int m = 0;
-      std::map<int,int> cellsafe;
-      std::map<int,int>::iterator cells;
-      std::set<int> cells_taken;
-      std::set<int>::iterator cellset;
-      std::vector<float> size_in_x;
-      std::set<float>::iterator vit;
-      std::set<float> size_in_y;
-    
-      bool taken = true;
-
-      cluster.clear();
-      cellsafe.clear();
-      cells_taken.clear();
-      size_in_x.clear();
-      size_in_y.clear();
-      final.clear();
-
-      // Locate the center of a logic pattern
-      float mindistance;
-      int closest_cell = -1;
-      float maximumy;
-      for( mapit = modmap.begin(); mapit != modmap.end(); mapit++ ){
-	sf::Vector2f temp = (*mapit).second.getPosition();
-	sf::Vector2f D = nodetemp - temp;
-	float distance = sqrt( pow(D.x,2) + pow(D.y,2) );
-	if( closest_cell == -1 || distance < mindistance ){
-	  mindistance = distance;
-	  closest_cell = mapit->first;
-	  maximumy = temp.y;
-	}
-      }
-      cluster[n++] = modmap[closest_cell];
-      cellsafe[m++] = closest_cell;
-      cells_taken.insert( closest_cell );
-      size_in_x.push_back( maximumy );
-      size_in_y.insert( maximumy );
-    
-      // Nearest neighbors routine
-      clusterit = cluster.begin();
-      while( clusterit != cluster.end() && cluster.size() < maxclustersize ){
-	centerlogic = clusterit->second.getPosition();
-	int clusterindex = clusterit->first; //position in cluster array
-	int clustercell = cellsafe[clusterindex];
-
-	// Get the closest modules and add to Logic Cluster
-	for( clustit = modmap.begin(); clustit != modmap.end(); clustit++ ) {
-	  int clustcell = clustit->first;
-	  if( clustcell != clustercell ){
-	    taken = true;
-	    neighbors = clustit->second.getPosition();
-	    sf::Vector2f Dclust = neighbors - centerlogic;
-	    sf::Vector2f Dnode = neighbors - nodetemp;
-	    float distance = sqrt( pow(Dclust.x,2) + pow(Dclust.y,2) );
-
-	    if( fabs(Dnode.x) < clustercutx*size42 && fabs(Dnode.y) < clustercuty*size42 && cluster.size() < maxclustersize && distance < 1.2*size42 ) {
-	    
-	      taken =  cells_taken.find( clustit->first ) != cells_taken.end(); 
-	      int mycount_in_x = 0;
-	      int mycount_in_y = 0;
-	      if( !taken ) {
-		size_in_x.push_back( neighbors.y );
-		size_in_y.insert( neighbors.y );
-		mycount_in_x = std::count( size_in_x.begin(), size_in_x.end(), neighbors.y );
-		mycount_in_y = size_in_y.size(); 
-
-		if( cells_taken.size() < maxclustersize ) {	      
-		  if( mycount_in_x <= 4 && mycount_in_y <= 8 ) {
-		    cellsafe[ m++ ] = clustit->first;
-		    cluster[ n++ ] = clustit->second;
-		    cells_taken.insert( clustit->first );
-		  }
-		}
-	      
-	      }
-	    }	    	  
-	  }   
-	} 
-	++clusterit;
-      }
-      // for( vit = size_in_y.begin(); vit != size_in_y.end(); vit++ ) {
-      //   std::cout << *vit << std::endl;
-      // }
-      // std::cout << size_in_y.size() << std::endl;
-    
-      // Change color of clusters - overlaps handled in colorthelogic() 
-      // ***this routine is necessary to make a map of cell number and shape
-      for( clustit = cluster.begin(); clustit != cluster.end(); clustit++ ) {
-	int temp = i % colors.size();
-	(*clustit).second.setFillColor( colors[temp] );
-	for( cells = cellsafe.begin(); cells != cellsafe.end(); cells++ ) {
-	  // counting variable must be equal
-	  if( clustit->first == cells->first ) {
-	    // make the final map 
-	    final[cells->second] = clustit->second;
-	  }
-	}
+      chosen.push_back( i );
+    }
+  }
+
+  // Locate the center of every logic pattern and grow it
+  ProfileScope growth("triggerlogic: build groups");
+  LogicSnapshot empty( positions, maxclustersize, size42 );
+  history.reset( empty.withnodes( builder, chosen ) );
+  growth.stop();
+
+  showlogic();
+  for( int g=0; g<history.current().groups(); g++ ) {
+    added += history.current().group(g).cells.size();
+  }
+  PROFILE_COUNTER("triggerlogic: cells added", added);
+  PROFILE_COUNTER("logic groups", global_logic.size());
+}
+
+void ECal::showlogic() {
+  PROFILE_SCOPE("showlogic");
+  const LogicSnapshot& logic = history.current();
+  global_logic.clear();
+  for( int g=0; g<logic.groups(); g++ ) {
+    final.clear();
+    // Change color of clusters - overlaps handled in colorthelogic() 
+    // ***this routine is necessary to make a map of cell number and shape
+    const LogicGroup& group = logic.group(g);
+    for( int k=0; k<int(group.cells.size()); k++ ) {
+      final[ group.cells[k] ] = modmap[ group.cells[k] ];
+      final[ group.cells[k] ].setFillColor( colors[ group.node % colors.size() ] );
+    }
+    // Add to global logic vector used throughout the rest of the code
+    global_logic.push_back( final );
+  }
+}
+
+void ECal::relayout(const char* what) {
+  // Redraw the fills and borders for a new current snapshot. Only the
+  // drawing is redone, the snapshots share every unchanged group.
+  PROFILE_SCOPE("relayout");
+  showlogic();
+  colorthelogic();
+  manyboarders.clear();
+  logicboarder();
+  invalidate( kModules );
+  invalidate( kFills );
+  invalidate( kBorders );
+
+  const LogicSnapshot& now = history.current();
+  std::cout << what << ": " << now.groups() << " groups, "
+	    << now.excludedcells().size() << " modules excluded, "
+	    << now.shared( history.remembered() ) << " groups shared with the remembered layout, "
+	    << history.steps() << " undo steps" << std::endl;
+}
+
+bool ECal::handleclick(sf::Vector2f position, bool node) {
+  // Edit the logic: toggle the node nearest the click, or exclude and
+  // include again the module under it. Returns true if the scene changed
+  if( loading() ) return false;
+  if( node ) {
+    int nearest = -1;
+    float best = 0.5*increment;
+    for( int i=0; i<int(nodes.size()); i++ ) {
+      sf::Vector2f d = nodes[i].getPosition() - position;
+      float distance = sqrt( d.x*d.x + d.y*d.y );
+      if( distance < best ) {
+	best = distance;
+	nearest = i;
       }
-      // Add to global logic vector used throughout the rest of the code
-      global_logic.push_back( final );
-      
     }
+    if( nearest < 0 || !history.edit( history.current().togglenode( builder, nearest ) ) ) return false;
+    relayout( "Node toggled" );
+    return true;
   }
+  std::map<int,sf::RectangleShape>::const_iterator mod;
+  for( mod = modmap.begin(); mod != modmap.end(); mod++ ) {
+    if( mod->second.getGlobalBounds().contains( position ) ) break;
+  }
+  if( mod == modmap.end() || !history.edit( history.current().togglecell( builder, mod->first ) ) ) return false;
+  relayout( "Module toggled" );
+  return true;
 }
 
 void ECal::colorthelogic() {
+  PROFILE_SCOPE("colorthelogic");
   // Use cell number to compare if cluster cells overlap
   for( glit = global_logic.begin(); glit != global_logic.end(); glit++ ) {
     for( clustit = glit->begin(); clustit != glit->end(); clustit++ ) {
@@ -510,6 +439,7 @@ void ECal::colorthelogic() {
 }
 
 void ECal::logicboarder() {
+  PROFILE_SCOPE("logicboarder");
   maxy = -1;
   miny = 10000;
   maxx = -1;
@@ -729,95 +659,97 @@ void ECal::specs() {
 }
 
 void ECal::logicinfo() {  
-  // Spit out a text file with cell number + location in x and y (mm) relative
-  // to the center of ECal
-  std::ofstream logic_file("ecal_triggerlogic_oct15_FINAL.txt");
-  if( logic_file.is_open() ) {
-    logic_file << "# Units are in mm. ECal is shifted by +40 mm in y relative to previous output." << std::endl;
-    logic_file << "# Coordinates are relative to ECal center, same system as G4SBS" << std::endl;
-    logic_file << "# Number of logic patterns = " << global_logic.size() << std::endl;
-    logic_file << "# Type 42: " << count42 << std::endl;
-    logic_file << "# Type 40: " << count40 << std::endl;
-    logic_file << "# Type 38: " << count38 << std::endl;
-    logic_file << "# Total number of modules: " << count << std::endl;
-    logic_file << std::endl;
-    logic_file << std::setw(5) << "#cell" << std::setw(5) << "x" 
-	       << std::setw(5) << "y"    << std::setw(7) << "size" << std::endl; 
-    
-    for( glit = global_logic.begin(); glit != global_logic.end(); glit++ ) {
-      for( mapit = glit->begin(); mapit != glit->end(); mapit++ ) {
-	sf::Vector2f temp = mapit->second.getPosition() - center;
-	sf::Vector2f size = mapit->second.getSize();
-	
-	logic_file << std::setw(5) << mapit->first << std::setw(6) << temp.x 
-		   << std::setw(6) << -1*temp.y    << std::setw(5) << size.x << std::endl; 
-      }
-      logic_file << "######################" << std::endl;
+  PROFILE_SCOPE("logicinfo");
+  // Spit out the logic with cell number + location in x and y (mm) relative
+  // to the center of ECal. One pass collects the patterns, then every
+  // format is written in parallel.
+  LogicExportData data;
+  data.count = count;
+  data.count42 = count42;
+  data.count40 = count40;
+  data.count38 = count38;
+  data.layoutmaxcell = table.maxcell();
+  // Runs next to the other start up tasks, so no shared iterators
+  std::vector<std::map<int,sf::RectangleShape> >::const_iterator group;
+  std::map<int,sf::RectangleShape>::const_iterator cell;
+  for( group = global_logic.begin(); group != global_logic.end(); group++ ) {
+    for( cell = group->begin(); cell != group->end(); cell++ ) {
+      sf::Vector2f temp = cell->second.getPosition() - center;
+      sf::Vector2f size = cell->second.getSize();
+      data.add( cell->first, temp.x, -1*temp.y, size.x );
     }
+    data.endgroup();
   }
-  else std::cerr << "Error opening text output." << std::endl;
-  
-  logic_file.close();
-}
 
-void ECal::controldrawings(sf::Time elapsed) {
-  time += elapsed.asSeconds();
-  if(time > 0.30 ){
-    control = true;
+  std::string base = "ecal_triggerlogic_oct15_FINAL";
+  LogicExporter exporter;
+  exporter.add( new G4SBSWriter( base + ".txt" ) );
+  exporter.add( new CSVWriter( base + ".csv" ) );
+  exporter.add( new BinaryWriter( base + ".bin" ) );
+  exporter.add( new CellMaskWriter( base + "_cell2group.mem" ) );
+  exporter.add( new GroupListWriter( base + "_group2cell.mem" ) );
+  if( !exporter.run( data ) ) {
+    std::cerr << "Error opening text output." << std::endl;
   }
-  if(control) {
-    if( sf::Keyboard::isKeyPressed(sf::Keyboard::A) ) {
-      logboarders = true;
-      control = false;
-      time = 0;
-      count1++;
-      if(count1%2==0) {
-	logboarders = false;
-      }
+}
+
+bool ECal::handlekey(sf::Keyboard::Key key) {
+  // Returns true if the scene has to be redrawn
+  switch( key ) {
+  case sf::Keyboard::A : logboarders = !logboarders;
+    return true;
+  case sf::Keyboard::Z : logcolors = !logcolors;
+    return true;
+  case sf::Keyboard::Q : crescent = !crescent;
+    return true;
+  case sf::Keyboard::X : indexthenodes = !indexthenodes;
+    return true;
+  case sf::Keyboard::C : indexthemods = !indexthemods;
+    return true;
+  // Logic layout history, only once the start up tasks are done
+  case sf::Keyboard::U :
+    if( loading() || !history.undo() ) return false;
+    relayout( "Undo" );
+    return true;
+  case sf::Keyboard::R :
+    if( loading() || !history.redo() ) return false;
+    relayout( "Redo" );
+    return true;
+  case sf::Keyboard::S :
+    if( loading() ) return false;
+    history.remember();
+    std::cout << "Layout remembered, Tab switches to it" << std::endl;
+    return false;
+  case sf::Keyboard::Tab :
+    if( loading() || !history.swap() ) return false;
+    relayout( "Switched layout" );
+    return true;
+  case sf::Keyboard::P :
+    // Toggle stage profiling, dump what was recorded when switching off.
+    // Not while the start up tasks are still recording.
+    if( loading() ) return false;
+    if( Profiler::on() ) {
+      Profiler::enable( false );
+      Profiler::writetrace( "ecal_trace.json" );
+      Profiler::summary( std::cout );
     }
-    if( sf::Keyboard::isKeyPressed(sf::Keyboard::Z) ) {
-      logcolors = true;
-      control = false;
-      time = 0;
-      count2++;
-      if(count2%2==0){
-	logcolors = false;
-      }
-    } 
-    if( sf::Keyboard::isKeyPressed(sf::Keyboard::Q) ) {
-      crescent = true;
-      control = false;
-      time = 0;
-      count3++;
-      if(count3%2==0){
-	crescent = false;
-      }
-    } 
-    if( sf::Keyboard::isKeyPressed(sf::Keyboard::X) ) {
-      indexthenodes = true;
-      control = false;
-      time = 0;
-      count4++;
-      if(count4%2==0){
-    	indexthenodes = false;
-      }
-    } 
-    if( sf::Keyboard::isKeyPressed(sf::Keyboard::C) ) {
-      indexthemods = true;
-      control = false;
-      time = 0;
-      count5++;
-      if(count5%2==0){
-    	indexthemods = false;
-      }
-    } 
+    else {
+      Profiler::enable( true );
+    }
+    return false;
+  default :
+    return false;
   }
 }
 
 void ECal::indexnodes() {
+  PROFILE_SCOPE("indexnodes");
   int nodeindex = 1;
   int modindex = 1;
   sf::Vector2f offset( 2*nodeR, 0.0 );
+  // Runs next to the logic tasks, so no shared iterators
+  std::vector<sf::CircleShape>::const_iterator nodit;
+  std::map<int,sf::RectangleShape>::const_iterator mapit;
   
   for( nodit = nodes.begin(); nodit != nodes.end(); nodit++ ) { 
     // Handle the index text - int conversion to string
@@ -858,24 +790,172 @@ void ECal::indexnodes() {
   }
 }
 
-void ECal::draw(sf::RenderTarget& target, sf::RenderStates) const{
-  std::map<int,sf::RectangleShape>::const_iterator cit;
-  if( !crescent ) {
-    if( global_logic.size() != nodes.size() ) {
-      for( cit = modmap.begin(); cit != modmap.end(); cit++ ){
-	target.draw( cit->second );
+void ECal::startup() {
+  // Everything after the geometry, as tasks. The logic chain is the only
+  // part that grows with the number of patterns; the labels and the file
+  // output run next to it. Call initializeECal() first.
+  std::vector<int> after;
+  int font = startuptasks.add( "font", [this]() { loadfont(); } );
+  startuptasks.add( "TE layout", [this]() { TEregion.write( "TE_layout_oct13.txt" ); } );
+  int logic = startuptasks.add( "logic", [this]() { triggerlogic(); } );
+  after.assign( 1, logic );
+  int colours = startuptasks.add( "colours", [this]() { colorthelogic(); }, after );
+  after.assign( 1, colours );
+  int borders = startuptasks.add( "borders", [this]() { logicboarder(); }, after );
+  after.assign( 1, font );
+  int labels = startuptasks.add( "labels", [this]() { indexnodes(); }, after );
+  // Only reads the cell positions, which colouring leaves alone
+  after.assign( 1, logic );
+  startuptasks.add( "logic output", [this]() { logicinfo(); }, after );
+
+  layertask[kFills] = colours;
+  layertask[kBorders] = borders;
+  layertask[kNodeLabels] = labels;
+  layertask[kModLabels] = labels;
+
+  int nworkers = std::thread::hardware_concurrency();
+  startuptasks.start( nworkers > 3 ? nworkers : 3 );
+}
+
+bool ECal::update() {
+  // Pick up the start up tasks that finished since the last frame.
+  // Returns true if a layer became ready and the scene has to be redrawn
+  bool redraw = false;
+  int task;
+  while( startuptasks.poll( task ) ) {
+    polledtasks++;
+    for( int l=0; l<kLayers; l++ ) {
+      if( layertask[l] == task ) {
+	layerready[l] = true;
+	invalidate( l );
+	redraw = true;
       }
     }
-    target.draw( boarder );
   }
+  // The modules under a complete set of fills are not drawn
+  if( layerdirty[kFills] ) invalidate( kModules );
+  return redraw;
+}
 
+void ECal::finish() {
+  // Block until every start up task is done, e.g. before the replay
+  startuptasks.wait();
+  update();
+}
+
+void ECal::drawlayer(sf::RenderTarget& target, int layer) const {
+  std::map<int,sf::RectangleShape>::const_iterator cit;
   std::vector<std::map<int,sf::RectangleShape> >::const_iterator glit_const;
-  if( !logcolors ){
+  std::vector<std::vector<sf::VertexArray> >::const_iterator cit3;
+  std::vector<sf::VertexArray>::const_iterator cit2;
+  std::vector<sf::Text>::const_iterator textit;
+
+  // A task may still be filling this layer
+  if( !layerready[layer] ) return;
+
+  switch( layer ) {
+  case kModules :
+    if( !layerready[kFills] || global_logic.size() != nodes.size() ) {
+      for( cit = modmap.begin(); cit != modmap.end(); cit++ ){
+	target.draw( cit->second );
+      }
+    }
+    break;
+  case kFills :
     for( glit_const = global_logic.begin(); glit_const != global_logic.end(); glit_const++ ) {
       for( cit = glit_const->begin(); cit != glit_const->end(); cit++ ) {
 	target.draw( (*cit).second );
       }
     }
+    break;
+  case kBorders :
+    for( cit3 = manyboarders.begin(); cit3 != manyboarders.end(); cit3++ ) {
+      for( cit2 = cit3->begin(); cit2 != cit3->end(); cit2++ ) {
+	target.draw(*cit2);
+      }
+    }
+    break;
+  case kNodeLabels :
+    for( textit = textnodes.begin(); textit != textnodes.end(); textit++ ) {
+      target.draw( *textit );
+    }
+    break;
+  case kModLabels :
+    for( textit = textmods.begin(); textit != textmods.end(); textit++ ) {
+      target.draw( *textit );
+    }
+    break;
+  default :
+    break;
+  }
+}
+
+void ECal::renderlayers() const {
+  // Render every changed layer into its own texture covering the ECal
+  // plus a margin for the labels, at one texel per mm. Toggling a layer
+  // then only changes which textures are composited. If the textures
+  // cannot be made (too large for the graphics card) the layers are
+  // drawn directly instead.
+  PROFILE_SCOPE("ECal::renderlayers");
+  sf::FloatRect bounds = boarder.getGlobalBounds();
+  float margin = increment;
+  layerrect = sf::FloatRect( bounds.left - margin, bounds.top - margin,
+			     bounds.width + 2*margin, bounds.height + 2*margin );
+  unsigned int width = ceil( layerrect.width );
+  unsigned int height = ceil( layerrect.height );
+  unsigned int maxsize = sf::Texture::getMaximumSize();
+  sf::View layerview( layerrect );
+
+  layerscached = width <= maxsize && height <= maxsize;
+  for( int l=0; l<kLayers && layerscached; l++ ) {
+    if( !layerdirty[l] ) continue;
+    sf::Vector2u size = layers[l].getSize();
+    if( size.x != width || size.y != height ) {
+      if( !layers[l].create( width, height ) ) {
+	std::cerr << "Could not cache drawing layers, drawing directly." << std::endl;
+	layerscached = false;
+	break;
+      }
+    }
+    layers[l].setView( layerview );
+    layers[l].clear( sf::Color::Transparent );
+    drawlayer( layers[l], l );
+    layers[l].display();
+    layerdirty[l] = false;
+  }
+}
+
+void ECal::drawcached(sf::RenderTarget& target, int layer, bool direct) const {
+  if( !layerready[layer] ) return;
+  if( layerscached && !direct ) {
+    sf::Sprite sprite( layers[layer].getTexture() );
+    sprite.setPosition( layerrect.left, layerrect.top );
+    target.draw( sprite );
+  }
+  else {
+    drawlayer( target, layer );
+  }
+}
+
+void ECal::draw(sf::RenderTarget& target, sf::RenderStates) const{
+  PROFILE_SCOPE("ECal::draw");
+  // Zoomed in past one pixel per mm the cached texels would be magnified
+  // and blur, so the layers are drawn as shapes and text instead
+  bool direct = target.getView().getSize().x < target.getSize().x;
+  bool dirty = false;
+  for( int l=0; l<kLayers; l++ ) dirty = dirty || layerdirty[l];
+  if( dirty && !direct ) {
+    renderlayers();
+  }
+
+  // The red box is translucent, so it is drawn directly rather than
+  // blended twice through a layer texture
+  if( !crescent ) {
+    drawcached( target, kModules, direct );
+    target.draw( boarder );
+  }
+  if( !logcolors ){
+    drawcached( target, kFills, direct );
   }
 
   std::vector<sf::CircleShape>::const_iterator cit1;
@@ -883,25 +963,13 @@ void ECal::draw(sf::RenderTarget& target, sf::RenderStates) const{
     target.draw(*cit1);
   }
 
-  std::vector<std::vector<sf::VertexArray> >::const_iterator cit3;
-  std::vector<sf::VertexArray>::const_iterator cit2;
   if( logboarders ) {
-    for( cit3 = manyboarders.begin(); cit3 != manyboarders.end(); cit3++ ) {
-      for( cit2 = cit3->begin(); cit2 != cit3->end(); cit2++ ) {
-	target.draw(*cit2);
-      }
-    }
+    drawcached( target, kBorders, direct );
   }
-
-  std::vector<sf::Text>::const_iterator textit;
   if( indexthenodes ) {
-    for( textit = textnodes.begin(); textit != textnodes.end(); textit++ ) {
-      target.draw( *textit );
-    }
+    drawcached( target, kNodeLabels, direct );
   }
   if( indexthemods ) {
-    for( textit = textmods.begin(); textit != textmods.end(); textit++ ) {
-      target.draw( *textit );
-    }
+    drawcached( target, kModLabels, direct );
   }
 }
@@ -0,0 +1,199 @@
+#include "../include/EfficiencyMap.hh"
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+
+EfficiencyMap::EfficiencyMap(const Layout& table, const LogicTable& patterns, const ShowerGenerator& showers, float gridstep) {
+  layout = &table;
+  logic = &patterns;
+  generator = &showers;
+  step = gridstep > 0 ? gridstep : 5.0;
+  npoints = 0;
+  tilesize = 32;
+
+  float minx = 0, maxx = 0, miny = 0, maxy = 0;
+  for( int i=0; i<layout->size(); i++ ) {
+    const Module& mod = layout->module(i);
+    float half = 0.5*mod.type;
+    minx = std::min( minx, mod.x - half );
+    maxx = std::max( maxx, mod.x + half );
+    miny = std::min( miny, mod.y - half );
+    maxy = std::max( maxy, mod.y + half );
+  }
+  x0 = minx + 0.5*step;
+  y0 = miny + 0.5*step;
+  nx = int( (maxx - minx) / step );
+  ny = int( (maxy - miny) / step );
+
+  // Module -> patterns by counting sort
+  int nmod = layout->size();
+  modstart.assign( nmod+1, 0 );
+  for( int g=0; g<logic->groups(); g++ ) {
+    int n;
+    const int* mods = logic->groupmodules( g, n );
+    for( int k=0; k<n; k++ ) if( mods[k] >= 0 ) modstart[ mods[k]+1 ]++;
+  }
+  for( int i=0; i<nmod; i++ ) modstart[i+1] += modstart[i];
+  modgroups.resize( modstart[nmod] );
+  std::vector<int> fill( modstart.begin(), modstart.end()-1 );
+  for( int g=0; g<logic->groups(); g++ ) {
+    int n;
+    const int* mods = logic->groupmodules( g, n );
+    for( int k=0; k<n; k++ ) if( mods[k] >= 0 ) modgroups[ fill[ mods[k] ]++ ] = g;
+  }
+}
+
+void EfficiencyMap::scan(const RegionMask& region, float energy, const LogicParams* params, int nthreads, int tile) {
+  // Handle marking the grid points on region modules
+  inside.assign( nx*ny, 0 );
+  for( int i=0; i<layout->size(); i++ ) {
+    const Module& mod = layout->module(i);
+    if( !region.test( mod.cell ) ) continue;
+    float half = 0.5*mod.type;
+    int i0 = std::max( 0, int( ceil( (mod.x - half - x0) / step ) ) );
+    int i1 = std::min( nx-1, int( floor( (mod.x + half - x0) / step ) ) );
+    int j0 = std::max( 0, int( ceil( (mod.y - half - y0) / step ) ) );
+    int j1 = std::min( ny-1, int( floor( (mod.y + half - y0) / step ) ) );
+    for( int j=j0; j<=j1; j++ ) {
+      for( int k=i0; k<=i1; k++ ) inside[ j*nx + k ] = 1;
+    }
+  }
+  npoints = std::count( inside.begin(), inside.end(), 1 );
+  best.assign( nx*ny, 0 );
+  bestgroup.assign( nx*ny, -1 );
+  pass.assign( nx*ny, 0 );
+
+  if( params && params->size() != logic->groups() ) params = 0;
+  tilesize = tile > 0 ? tile : 32;
+  if( nthreads < 1 ) nthreads = 1;
+  int tilesx = ( nx + tilesize - 1 ) / tilesize;
+  int tilesy = ( ny + tilesize - 1 ) / tilesize;
+  int ntiles = tilesx * tilesy;
+
+  // Tiles are handed out one at a time, so threads stay busy even where
+  // the region only covers part of the grid
+  std::atomic<int> next( 0 );
+  std::vector<std::thread> workers;
+  for( int t=0; t<nthreads; t++ ) {
+    workers.push_back( std::thread( [&]() {
+	  std::vector<float> sums( logic->groups(), 0 );
+	  std::vector<int> touched;
+	  std::vector<int> modules( generator->maxfootprint() );
+	  std::vector<float> deposit( modules.size() );
+	  touched.reserve( logic->groups() );
+	  int t;
+	  while( ( t = next++ ) < ntiles ) {
+	    scantile( (t % tilesx) * tilesize, (t / tilesx) * tilesize, energy, params, sums, touched, modules, deposit );
+	  }
+	} ) );
+  }
+  for( int t=0; t<nthreads; t++ ) workers[t].join();
+}
+
+void EfficiencyMap::scantile(int ix0, int iy0, float energy, const LogicParams* params,
+			     std::vector<float>& sums, std::vector<int>& touched,
+			     std::vector<int>& modules, std::vector<float>& deposit) {
+  int ix1 = std::min( nx, ix0 + tilesize );
+  int iy1 = std::min( ny, iy0 + tilesize );
+  for( int j=iy0; j<iy1; j++ ) {
+    for( int i=ix0; i<ix1; i++ ) {
+      int p = j*nx + i;
+      if( !inside[p] ) continue;
+      float x = x0 + i*step;
+      float y = y0 + j*step;
+      int n = generator->footprint( x, y, 1.0, &modules[0], &deposit[0] );
+
+      // Spread the footprint onto the patterns of the modules it reaches
+      touched.clear();
+      for( int k=0; k<n; k++ ) {
+	int mod = modules[k];
+	if( deposit[k] <= 0 ) continue;
+	for( int m=modstart[mod]; m<modstart[mod+1]; m++ ) {
+	  int g = modgroups[m];
+	  if( sums[g] == 0 ) touched.push_back( g );
+	  sums[g] += deposit[k];
+	}
+      }
+
+      float top = 0;
+      int topgroup = -1;
+      bool fired = false;
+      for( size_t k=0; k<touched.size(); k++ ) {
+	int g = touched[k];
+	if( sums[g] > top || ( sums[g] == top && g < topgroup ) ) {
+	  top = sums[g];
+	  topgroup = g;
+	}
+	if( params && energy * sums[g] > params->cut(g) ) fired = true;
+	sums[g] = 0;
+      }
+      best[p] = top;
+      bestgroup[p] = topgroup;
+      pass[p] = fired;
+    }
+  }
+}
+
+bool EfficiencyMap::writemap(const std::string& filename) const {
+  FILE* out = fopen( filename.c_str(), "w" );
+  if( !out ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  fprintf( out, "# x(mm) y(mm) best-fraction best-pattern pass, %g mm grid, patterns from 1, 0 for none\n", step );
+  for( int j=0; j<ny; j++ ) {
+    for( int i=0; i<nx; i++ ) {
+      int p = j*nx + i;
+      if( !inside[p] ) continue;
+      fprintf( out, "%.1f %.1f %.4f %d %d\n", x0 + i*step, y0 + j*step, best[p], bestgroup[p]+1, int(pass[p]) );
+    }
+  }
+  fclose( out );
+  return true;
+}
+
+bool EfficiencyMap::writegroups(const std::string& filename) const {
+  FILE* out = fopen( filename.c_str(), "w" );
+  if( !out ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  int ngroups = logic->groups();
+  std::vector<int> count( ngroups, 0 ), fired( ngroups, 0 );
+  std::vector<double> sum( ngroups, 0 );
+  std::vector<float> lowest( ngroups, 1 );
+  for( int p=0; p<nx*ny; p++ ) {
+    int g = bestgroup[p];
+    if( !inside[p] || g < 0 ) continue;
+    count[g]++;
+    fired[g] += pass[p];
+    sum[g] += best[p];
+    lowest[g] = std::min( lowest[g], best[p] );
+  }
+  fprintf( out, "# pattern points mean-best lowest-best pass-fraction\n" );
+  for( int g=0; g<ngroups; g++ ) {
+    fprintf( out, "%d %d %.4f %.4f %.4f\n", g+1, count[g], count[g] ? sum[g] / count[g] : 0.0,
+	     count[g] ? lowest[g] : 0.0f, count[g] ? double(fired[g]) / count[g] : 0.0 );
+  }
+  fclose( out );
+  return true;
+}
+
+void EfficiencyMap::report(std::ostream& out, float fraction) const {
+  long above = 0, fired = 0;
+  double sum = 0;
+  for( int p=0; p<nx*ny; p++ ) {
+    if( !inside[p] ) continue;
+    sum += best[p];
+    above += ( best[p] >= fraction );
+    fired += pass[p];
+  }
+  out << npoints << " points on a " << step << " mm grid" << std::endl;
+  if( npoints == 0 ) return;
+  out << "mean best fraction " << sum / npoints << ", "
+      << 100.0 * above / npoints << "% of points at or above " << fraction << ", "
+      << 100.0 * fired / npoints << "% over threshold" << std::endl;
+}
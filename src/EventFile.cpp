@@ -0,0 +1,112 @@
+#include "../include/EventFile.hh"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+bool EventReader::open(const std::string& filename) {
+  close();
+  file = fopen( filename.c_str(), "r" );
+  if( !file ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void EventReader::close() {
+  if( file ) fclose( file );
+  file = 0;
+}
+
+bool EventReader::rewind() {
+  if( !file ) return false;
+  ::rewind( file );
+  return true;
+}
+
+bool EventReader::nextraw(std::string& raw) {
+  raw.clear();
+  if( !file ) return false;
+
+  int id, nhits = -1;
+  while( fgets( line, sizeof(line), file ) ) {
+    if( line[0] == '#' ) continue;
+    if( sscanf( line, "event %d %d", &id, &nhits ) == 2 ) break;
+  }
+  if( nhits < 0 ) return false;
+  raw += line;
+
+  int n = 0;
+  while( n < nhits && fgets( line, sizeof(line), file ) ) {
+    if( line[0] == '#' ) continue;
+    raw += line;
+    n++;
+  }
+  return n == nhits;
+}
+
+bool EventReader::parse(const std::string& raw, Event& event) {
+  event.clear();
+  const char* p = raw.c_str();
+  const char* end = strchr( p, '\n' );
+  int nhits;
+  if( !end || sscanf( p, "event %d %d", &event.id, &nhits ) != 2 ) return false;
+
+  // One line at a time, so a short line can not take a number from the next
+  char hit[256];
+  for( p = end+1; *p; p = end+1 ) {
+    end = strchr( p, '\n' );
+    if( !end ) end = p + strlen( p );
+    size_t length = std::min( size_t( end - p ), sizeof(hit) - 1 );
+    memcpy( hit, p, length );
+    hit[length] = 0;
+    int cell;
+    float energy;
+    if( sscanf( hit, "%d %f", &cell, &energy ) == 2 ) event.add( cell, energy );
+    if( !*end ) break;
+  }
+  return int(event.cells.size()) == nhits;
+}
+
+bool EventReader::next(Event& event) {
+  if( !file ) return false;
+  event.clear();
+
+  int nhits = -1;
+  while( fgets( line, sizeof(line), file ) ) {
+    if( line[0] == '#' ) continue;
+    if( sscanf( line, "event %d %d", &event.id, &nhits ) == 2 ) break;
+  }
+  if( nhits < 0 ) return false;
+
+  while( int(event.cells.size()) < nhits && fgets( line, sizeof(line), file ) ) {
+    if( line[0] == '#' ) continue;
+    int cell;
+    float energy;
+    if( sscanf( line, "%d %f", &cell, &energy ) == 2 ) event.add( cell, energy );
+  }
+  return int(event.cells.size()) == nhits;
+}
+
+bool EventWriter::open(const std::string& filename) {
+  close();
+  file = fopen( filename.c_str(), "w" );
+  if( !file ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void EventWriter::close() {
+  if( file ) fclose( file );
+  file = 0;
+}
+
+void EventWriter::write(const Event& event) {
+  if( !file ) return;
+  fprintf( file, "event %d %d\n", event.id, int(event.cells.size()) );
+  for( int k=0; k<int(event.cells.size()); k++ ) {
+    fprintf( file, "%d %.2f\n", event.cells[k], event.energy[k] );
+  }
+}
@@ -0,0 +1,199 @@
+#include "../include/EventPipeline.hh"
+#include <thread>
+#include <chrono>
+#include <iomanip>
+
+namespace {
+  const char* stagenames[] = { "decode", "cluster", "trigger", "histogram" };
+  // Tries before a taker sleeps, short gaps are cheaper to yield through
+  const int kSpins = 16;
+  long nanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>
+      ( std::chrono::steady_clock::now().time_since_epoch() ).count();
+  }
+}
+
+EventPipeline::EventPipeline(const Layout& table, const LogicTable& patterns, const LogicParams& parameters, int poolsize) {
+  layout = &table;
+  logic = &patterns;
+  params = &parameters;
+  seedcut = 100;
+  cellcut = 10;
+  depth = poolsize > 1 ? poolsize : 2;
+  for( int s=0; s<kStages; s++ ) {
+    threads[s] = 1;
+    queues[s] = new BoundedQueue<PipelineItem*>( depth );
+    waiters[s].waiting = 0;
+  }
+  threads[kDecode] = threads[kCluster] = threads[kTrigger] = 2;
+  reader = 0;
+  seconds = 0;
+
+  pool.resize( depth );
+  for( int i=0; i<depth; i++ ) {
+    pool[i].energy.assign( layout->size(), 0 );
+    pool[i].sums.assign( logic->groups(), 0 );
+    pool[i].fired.assign( logic->groups(), 0 );
+  }
+
+  int ngroups = logic->groups();
+  hgroupsum = histograms.book( "groupsum", ngroups, 120, 0, 6000 );
+  hclusterenergy = histograms.book( "clusterenergy", 1, 200, 0, 10000 );
+  hclusters = histograms.book( "clusters", 1, 33, -0.5, 32.5 );
+  hhits = histograms.book( "hits", 1, 100, 0, 200 );
+  hfired = histograms.book( "fired", 1, ngroups, -0.5, ngroups-0.5 );
+  hnfired = histograms.book( "nfired", 1, 16, -0.5, 15.5 );
+}
+
+EventPipeline::~EventPipeline() {
+  for( int s=0; s<kStages; s++ ) delete queues[s];
+}
+
+bool EventPipeline::take(int stage, PipelineItem*& item) {
+  for( int spin=0; spin<kSpins; spin++ ) {
+    if( queues[stage]->pop( item ) ) return true;
+    std::this_thread::yield();
+  }
+
+  // Sleep until an item arrives or the stage before has finished and its
+  // queue is drained. The queue is checked again after announcing the
+  // wait, so a push either is seen here or sees the waiter and wakes it.
+  int previous = ( stage == kDecode ) ? kHistogram : stage-1;
+  QueueWaiters& w = waiters[stage];
+  counters[stage].stalls++;
+  std::unique_lock<std::mutex> guard( w.lock );
+  w.waiting++;
+  bool got;
+  while( true ) {
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if( (got = queues[stage]->pop( item )) ) break;
+    if( stage != kDecode && counters[previous].finished.load() ) {
+      got = queues[stage]->pop( item );
+      break;
+    }
+    w.moved.wait( guard );
+  }
+  w.waiting--;
+  return got;
+}
+
+void EventPipeline::give(int stage, PipelineItem* item) {
+  // Never full: a queue has at least as many slots as the pool has items
+  int next = ( stage+1 ) % kStages;
+  queues[next]->push( item );
+  wake( next );
+}
+
+void EventPipeline::wake(int queue) {
+  std::atomic_thread_fence( std::memory_order_seq_cst );
+  if( waiters[queue].waiting.load() == 0 ) return;
+  std::lock_guard<std::mutex> guard( waiters[queue].lock );
+  waiters[queue].moved.notify_all();
+}
+
+void EventPipeline::worker(int stage) {
+  ClusterFinder* finder = ( stage == kCluster ) ? new ClusterFinder( *layout, seedcut, cellcut ) : 0;
+  HistogramBuffer buffer;
+  if( stage == kHistogram ) histograms.attach( buffer );
+
+  PipelineItem* item;
+  while( take( stage, item ) ) {
+    long start = nanoseconds();
+    if( stage == kDecode ) {
+      // Handle clearing the previous event, then read and spread the
+      // next. Only fetching the lines is serialised, parsing is not.
+      for( size_t k=0; k<item->event.cells.size(); k++ ) {
+	int mod = layout->index( item->event.cells[k] );
+	if( mod >= 0 ) item->energy[mod] = 0;
+      }
+      bool more;
+      {
+	std::lock_guard<std::mutex> lock( readlock );
+	more = reader->nextraw( item->raw );
+      }
+      if( !more ) {
+	// Handle the end of the file, the item lets the next decoder see it too
+	item->event.clear();
+	queues[kDecode]->push( item );
+	wake( kDecode );
+	break;
+      }
+      if( !EventReader::parse( item->raw, item->event ) ) {
+	item->event.clear();
+	give( kHistogram, item );
+	continue;
+      }
+      for( size_t k=0; k<item->event.cells.size(); k++ ) {
+	int mod = layout->index( item->event.cells[k] );
+	if( mod >= 0 ) item->energy[mod] += item->event.energy[k];
+      }
+    }
+    else if( stage == kCluster ) {
+      finder->findclusters( &item->energy[0], item->clusters );
+    }
+    else if( stage == kTrigger ) {
+      logic->groupsums( &item->energy[0], &item->sums[0] );
+      item->nfired = params->passthreshold( &item->sums[0], 1, &item->fired[0] );
+    }
+    else {
+      buffer.fillall( hgroupsum, &item->sums[0] );
+      for( size_t c=0; c<item->clusters.size(); c++ ) {
+	buffer.fill( hclusterenergy, 0, item->clusters[c].energy );
+      }
+      buffer.fill( hclusters, 0, item->clusters.size() );
+      buffer.fill( hhits, 0, item->event.cells.size() );
+      buffer.fill( hnfired, 0, item->nfired );
+      if( item->nfired > 0 ) {
+	for( size_t g=0; g<item->fired.size(); g++ ) {
+	  if( item->fired[g] ) buffer.fill( hfired, 0, g );
+	}
+      }
+    }
+    counters[stage].busy += nanoseconds() - start;
+    counters[stage].items++;
+    give( stage, item );
+  }
+
+  delete finder;
+  if( stage == kHistogram ) histograms.add( buffer );
+  if( --counters[stage].running == 0 ) {
+    counters[stage].finished = true;
+    if( stage != kHistogram ) wake( stage+1 );
+  }
+}
+
+void EventPipeline::run(EventReader& events) {
+  reader = &events;
+  for( int s=0; s<kStages; s++ ) {
+    counters[s].items = 0;
+    counters[s].busy = 0;
+    counters[s].stalls = 0;
+    counters[s].running = threads[s];
+    counters[s].finished = false;
+  }
+  PipelineItem* item;
+  while( queues[kDecode]->pop( item ) );
+  for( int i=0; i<depth; i++ ) queues[kDecode]->push( &pool[i] );
+  histograms.clear();
+
+  long start = nanoseconds();
+  std::vector<std::thread> workers;
+  for( int s=0; s<kStages; s++ ) {
+    for( int t=0; t<threads[s]; t++ ) workers.push_back( std::thread( &EventPipeline::worker, this, s ) );
+  }
+  for( size_t t=0; t<workers.size(); t++ ) workers[t].join();
+  seconds = 1e-9 * ( nanoseconds() - start );
+}
+
+void EventPipeline::report(std::ostream& out) const {
+  out << histograms.entries( hclusters, 0 ) << " events in " << seconds << " s" << std::endl;
+  out << std::setw(10) << "stage" << std::setw(8) << "threads" << std::setw(12) << "events/s"
+      << std::setw(8) << "busy" << std::setw(12) << "stalls" << std::endl;
+  for( int s=0; s<kStages; s++ ) {
+    long items = counters[s].items;
+    double busy = ( seconds > 0 ) ? 1e-9 * counters[s].busy / ( seconds * threads[s] ) : 0;
+    out << std::setw(10) << stagenames[s] << std::setw(8) << threads[s]
+	<< std::setw(12) << long( seconds > 0 ? items / seconds : 0 )
+	<< std::setw(7) << int( 100*busy + 0.5 ) << "%" << std::setw(12) << counters[s].stalls << std::endl;
+  }
+}
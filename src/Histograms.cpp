@@ -0,0 +1,222 @@
+#include "../include/Histograms.hh"
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <algorithm>
+#include <iostream>
+
+void HistogramBuffer::fillall(int family, const float* x) {
+  const HistogramFamily& f = (*families)[family];
+  long* b = &bins[0] + f.offset;
+  for( int h=0; h<f.count; h++ ) {
+    b[ long(h)*f.stride + HistogramBuffer::binof( f, x[h] ) ]++;
+  }
+}
+
+void HistogramBuffer::clear() {
+  std::fill( bins.begin(), bins.end(), 0 );
+}
+
+int HistogramSet::book(const std::string& name, int count, int nbins, float lo, float hi) {
+  HistogramFamily f;
+  f.name = name;
+  f.count = count;
+  f.nbins = nbins > 0 ? nbins : 1;
+  f.lo = lo;
+  f.hi = hi;
+  f.scale = ( hi > lo ) ? f.nbins / ( hi - lo ) : 0;
+  f.stride = f.nbins + 2;
+  f.offset = total.size();
+  families.push_back( f );
+  total.resize( total.size() + long(count) * f.stride, 0 );
+  return families.size() - 1;
+}
+
+int HistogramSet::find(const std::string& name) const {
+  for( size_t f=0; f<families.size(); f++ ) {
+    if( families[f].name == name ) return f;
+  }
+  return -1;
+}
+
+void HistogramSet::attach(HistogramBuffer& buffer) const {
+  buffer.families = &families;
+  buffer.bins.assign( total.size(), 0 );
+}
+
+void HistogramSet::add(HistogramBuffer& buffer) {
+  std::lock_guard<std::mutex> guard( lock );
+  long n = total.size();
+  long* t = &total[0];
+  long* b = &buffer.bins[0];
+  for( long i=0; i<n; i++ ) t[i] += b[i];
+  buffer.clear();
+}
+
+void HistogramSet::clear() {
+  std::fill( total.begin(), total.end(), 0 );
+}
+
+long HistogramSet::entries(int family, int h) const {
+  const HistogramFamily& f = families[family];
+  long sum = 0;
+  for( int bin=0; bin<f.stride; bin++ ) sum += total[ f.offset + long(h)*f.stride + bin ];
+  return sum;
+}
+
+bool HistogramSet::writetext(const std::string& filename) const {
+  FILE* out = ( filename == "-" ) ? stdout : fopen( filename.c_str(), "w" );
+  if( !out ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  for( size_t f=0; f<families.size(); f++ ) {
+    const HistogramFamily& fam = families[f];
+    for( int h=0; h<fam.count; h++ ) {
+      fprintf( out, "# %s %d %d %g %g\n", fam.name.c_str(), h, fam.nbins, fam.lo, fam.hi );
+      const long* b = &total[0] + fam.offset + long(h)*fam.stride;
+      for( int bin=0; bin<fam.stride; bin++ ) fprintf( out, bin ? " %ld" : "%ld", b[bin] );
+      fputc( '\n', out );
+    }
+  }
+  if( out != stdout ) fclose( out );
+  else fflush( out );
+  return true;
+}
+
+namespace {
+  // Fixed width values as little endian bytes, whatever the host order
+  void put32(std::string& out, uint32_t word) {
+    char bytes[4] = { char(word), char(word >> 8), char(word >> 16), char(word >> 24) };
+    out.append( bytes, 4 );
+  }
+  void put64(std::string& out, uint64_t word) {
+    put32( out, uint32_t(word) );
+    put32( out, uint32_t(word >> 32) );
+  }
+  void putfloat(std::string& out, float x) {
+    uint32_t word;
+    memcpy( &word, &x, sizeof(word) );
+    put32( out, word );
+  }
+
+  // Reading moves pos along the buffer and fails past its end
+  bool get32(const std::string& in, size_t& pos, uint32_t& word) {
+    if( pos + 4 > in.size() ) return false;
+    const unsigned char* b = (const unsigned char*) in.data() + pos;
+    word = uint32_t(b[0]) | uint32_t(b[1]) << 8 | uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24;
+    pos += 4;
+    return true;
+  }
+  bool get64(const std::string& in, size_t& pos, uint64_t& word) {
+    uint32_t low, high;
+    if( !get32( in, pos, low ) || !get32( in, pos, high ) ) return false;
+    word = uint64_t(high) << 32 | low;
+    return true;
+  }
+  bool getfloat(const std::string& in, size_t& pos, float& x) {
+    uint32_t word;
+    if( !get32( in, pos, word ) ) return false;
+    memcpy( &x, &word, sizeof(x) );
+    return true;
+  }
+}
+
+bool HistogramSet::writebinary(const std::string& filename) const {
+  std::string data( "ECLH" );
+  put32( data, 2 );
+  put32( data, families.size() );
+  for( size_t f=0; f<families.size(); f++ ) {
+    const HistogramFamily& fam = families[f];
+    put32( data, fam.name.size() );
+    data.append( fam.name );
+    put32( data, fam.count );
+    put32( data, fam.nbins );
+    putfloat( data, fam.lo );
+    putfloat( data, fam.hi );
+  }
+  // Bins as runs: the number of empty bins, the number of filled bins
+  // after them, then their contents
+  long n = total.size();
+  for( long i=0; i<n; ) {
+    long zeros = i;
+    while( zeros < n && total[zeros] == 0 ) zeros++;
+    long filled = zeros;
+    while( filled < n && total[filled] != 0 ) filled++;
+    put32( data, zeros - i );
+    put32( data, filled - zeros );
+    for( long k=zeros; k<filled; k++ ) put64( data, total[k] );
+    i = filled;
+  }
+
+  FILE* out = fopen( filename.c_str(), "wb" );
+  if( !out ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  bool ok = fwrite( data.data(), 1, data.size(), out ) == data.size();
+  ok = ( fclose( out ) == 0 ) && ok;
+  if( !ok ) std::cerr << "Error writing " << filename << std::endl;
+  return ok;
+}
+
+bool HistogramSet::readbinary(const std::string& filename) {
+  FILE* in = fopen( filename.c_str(), "rb" );
+  if( !in ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  std::string data;
+  char chunk[65536];
+  size_t got;
+  while( ( got = fread( chunk, 1, sizeof(chunk), in ) ) > 0 ) data.append( chunk, got );
+  fclose( in );
+
+  // The booking in the file has to match this set exactly, an empty set
+  // takes the booking of the file
+  size_t pos = 4;
+  uint32_t version, nfamilies;
+  bool ok = data.compare( 0, 4, "ECLH" ) == 0 && get32( data, pos, version ) && version == 2
+    && get32( data, pos, nfamilies );
+  bool booking = families.empty();
+  ok = ok && ( booking || nfamilies == families.size() );
+  for( uint32_t f=0; ok && f<nfamilies; f++ ) {
+    uint32_t length, count, nbins;
+    float lo, hi;
+    ok = get32( data, pos, length ) && pos + length <= data.size();
+    if( !ok ) break;
+    std::string name = data.substr( pos, length );
+    pos += length;
+    ok = get32( data, pos, count ) && get32( data, pos, nbins )
+      && getfloat( data, pos, lo ) && getfloat( data, pos, hi );
+    if( ok && booking ) {
+      ok = nbins > 0 && ( uint64_t(count) * ( nbins+2 ) < ( uint64_t(1) << 32 ) );
+      if( ok ) book( name, count, nbins, lo, hi );
+    }
+    else if( ok ) {
+      const HistogramFamily& fam = families[f];
+      ok = name == fam.name && int(count) == fam.count && int(nbins) == fam.nbins
+	&& lo == fam.lo && hi == fam.hi;
+    }
+  }
+  std::vector<long> bins( total.size(), 0 );
+  long n = bins.size();
+  for( long i=0; ok && i<n; ) {
+    uint32_t zeros, filled;
+    ok = get32( data, pos, zeros ) && get32( data, pos, filled )
+      && long(zeros) + long(filled) <= n - i;
+    i += ok ? zeros : 0;
+    for( uint32_t k=0; ok && k<filled; k++ ) {
+      uint64_t value = 0;
+      ok = get64( data, pos, value );
+      bins[i++] = value;
+    }
+  }
+  ok = ok && pos == data.size();
+  if( !ok ) {
+    std::cerr << filename << " does not match the booked histograms" << std::endl;
+    return false;
+  }
+  for( long i=0; i<n; i++ ) total[i] += bins[i];
+  return true;
+}
@@ -0,0 +1,64 @@
+#include "../include/Layout.hh"
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+
+Layout::Layout() {
+  maxrow = 0;
+  maxcellnumber = 0;
+}
+
+bool Layout::read(const std::string& filename) {
+  std::ifstream layout( filename.c_str() );
+  if( !layout.is_open() ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+
+  modules.clear();
+  std::string line;
+  while( std::getline( layout, line) && line[0]!='#') {}
+
+  Module mod;
+  while( layout >> mod.type >> mod.cell >> mod.row >> mod.col >> mod.x >> mod.y >> mod.ncol ) {
+    modules.push_back( mod );
+    maxrow = (mod.row > maxrow) ? mod.row : maxrow;
+    maxcellnumber = (mod.cell > maxcellnumber) ? mod.cell : maxcellnumber;
+  }
+  layout.close();
+
+  cellindex.assign( maxcellnumber+1, -1 );
+  for( int i=0; i<int(modules.size()); i++ ) {
+    cellindex[ modules[i].cell ] = i;
+  }
+
+  // Same 1.2 module-size radius used by ECal::triggerlogic()
+  buildneighbors( 1.2 );
+  return true;
+}
+
+void Layout::buildneighbors(float radius) {
+  // Two modules are neighbours if their centers are closer than radius
+  // times their mean size. Rows are staggered, so this picks up the two
+  // touching modules in the rows above and below as well.
+  int n = modules.size();
+  neighborstart.assign( n+1, 0 );
+  neighborlist.clear();
+
+  for( int i=0; i<n; i++ ) {
+    neighborstart[i] = neighborlist.size();
+    for( int j=0; j<n; j++ ) {
+      if( i == j ) continue;
+      // only the adjacent rows can touch
+      if( abs( modules[j].row - modules[i].row ) > 1 ) continue;
+      float dx = modules[j].x - modules[i].x;
+      float dy = modules[j].y - modules[i].y;
+      float cut = radius * 0.5 * ( modules[i].type + modules[j].type );
+      if( dx*dx + dy*dy < cut*cut ) {
+	neighborlist.push_back( j );
+      }
+    }
+  }
+  neighborstart[n] = neighborlist.size();
+}
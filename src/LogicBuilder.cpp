@@ -0,0 +1,115 @@
+#include "../include/LogicBuilder.hh"
+#include "../include/LogicKernel.hh"
+#include <algorithm>
+#include <cmath>
+
+void LogicBuilder::setmodules(const int* cells, const float* x, const float* y, int n) {
+  cellnumbers.assign( cells, cells + n );
+  cellx.assign( x, x + n );
+  celly.assign( y, y + n );
+}
+
+int LogicBuilder::build(const float* nodex, const float* nodey, int nnodes, int maxcells, float size) {
+  arena.reset();
+  groupstart.clear();
+  groupcells.clear();
+  groupstart.push_back( 0 );
+  int ncells = cellnumbers.size();
+  if( ncells == 0 ) return 0;
+  const float* x = &cellx[0];
+  const float* y = &celly[0];
+
+  // Handle binning the modules for this pass, bins of two modules in CSR
+  // form with the modules of a bin in ascending order. Both arrays are
+  // sized by the module set, so they come from the arena.
+  float cutx = ( maxcells == 64 ? LogicKernel64::Shape::cutx() : LogicKernel32::Shape::cutx() ) * size;
+  float cuty = ( maxcells == 64 ? LogicKernel64::Shape::cuty() : LogicKernel32::Shape::cuty() ) * size;
+  float binsize = size > 0 ? 2*size : 1;
+  float minx = *std::min_element( x, x + ncells ), maxx = *std::max_element( x, x + ncells );
+  float miny = *std::min_element( y, y + ncells ), maxy = *std::max_element( y, y + ncells );
+  int nbinx = int( ( maxx - minx ) / binsize ) + 1;
+  int nbiny = int( ( maxy - miny ) / binsize ) + 1;
+  int* binstart = arena.array<int>( nbinx*nbiny + 1 );
+  int* binmodules = arena.array<int>( ncells );
+  int* modulebin = arena.array<int>( ncells );
+  std::fill( binstart, binstart + nbinx*nbiny + 1, 0 );
+  for( int j=0; j<ncells; j++ ) {
+    modulebin[j] = int( ( y[j] - miny ) / binsize ) * nbinx + int( ( x[j] - minx ) / binsize );
+    binstart[ modulebin[j] + 1 ]++;
+  }
+  for( int b=0; b<nbinx*nbiny; b++ ) binstart[b+1] += binstart[b];
+  for( int j=0; j<ncells; j++ ) binmodules[ binstart[ modulebin[j] ]++ ] = j;
+  for( int b=nbinx*nbiny; b>0; b-- ) binstart[b] = binstart[b-1];
+  binstart[0] = 0;
+
+  // Kernel output for one node, reused for every node of the pass
+  int* members = arena.array<int>( LogicKernel64::maxcells );
+  int* sorted = arena.array<int>( LogicKernel64::maxcells );
+  long added = 0;
+  for( int i=0; i<nnodes; i++ ) {
+    // Only modules inside the kernel's search box can join the group, so
+    // the kernels see just those, in ascending order as in the full set.
+    // The closest of them is the closest of all when it is nearer than
+    // any module outside the box can be; otherwise fall back to the full
+    // set.
+    size_t position = arena.mark();
+    int bx0 = std::max( 0, int( ( nodex[i] - cutx - minx ) / binsize ) );
+    int bx1 = std::min( nbinx-1, int( ( nodex[i] + cutx - minx ) / binsize ) );
+    int by0 = std::max( 0, int( ( nodey[i] - cuty - miny ) / binsize ) );
+    int by1 = std::min( nbiny-1, int( ( nodey[i] + cuty - miny ) / binsize ) );
+    int nnear = 0;
+    for( int by=by0; by<=by1; by++ ) {
+      for( int bx=bx0; bx<=bx1; bx++ ) nnear += binstart[ by*nbinx + bx + 1 ] - binstart[ by*nbinx + bx ];
+    }
+    int* near = arena.array<int>( nnear );
+    float* nearx = arena.array<float>( nnear );
+    float* neary = arena.array<float>( nnear );
+    int k = 0;
+    for( int by=by0; by<=by1; by++ ) {
+      for( int bx=bx0; bx<=bx1; bx++ ) {
+	for( int b=binstart[ by*nbinx + bx ]; b<binstart[ by*nbinx + bx + 1 ]; b++ ) near[k++] = binmodules[b];
+      }
+    }
+    std::sort( near, near + nnear );
+    for( k=0; k<nnear; k++ ) {
+      nearx[k] = x[ near[k] ];
+      neary[k] = y[ near[k] ];
+    }
+
+    int closest = nnear > 0 ? LogicKernel32::nearest( nearx, neary, nnear, nodex[i], nodey[i] ) : -1;
+    bool inside = false;
+    if( closest >= 0 ) {
+      double dx = nodex[i] - nearx[closest];
+      double dy = nodey[i] - neary[closest];
+      inside = sqrt( dx*dx + dy*dy ) < 0.99 * std::min( cutx, cuty );
+    }
+    int n;
+    if( inside ) {
+      if( maxcells == 64 ) {
+	n = LogicKernel64::grow( nearx, neary, nnear, closest, nodex[i], nodey[i], size, members );
+      }
+      else {
+	n = LogicKernel32::grow( nearx, neary, nnear, closest, nodex[i], nodey[i], size, members );
+      }
+      for( k=0; k<n; k++ ) members[k] = near[ members[k] ];
+    }
+    else {
+      closest = LogicKernel32::nearest( x, y, ncells, nodex[i], nodey[i] );
+      if( maxcells == 64 ) {
+	n = LogicKernel64::grow( x, y, ncells, closest, nodex[i], nodey[i], size, members );
+      }
+      else {
+	n = LogicKernel32::grow( x, y, ncells, closest, nodex[i], nodey[i], size, members );
+      }
+    }
+    arena.release( position );
+
+    // Cell numbers in map order; a group never holds a module twice
+    for( k=0; k<n; k++ ) sorted[k] = cellnumbers[ members[k] ];
+    std::sort( sorted, sorted + n );
+    groupcells.insert( groupcells.end(), sorted, sorted + n );
+    groupstart.push_back( groupcells.size() );
+    added += n;
+  }
+  return added;
+}
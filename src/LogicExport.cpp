@@ -0,0 +1,160 @@
+#include "../include/LogicExport.hh"
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <thread>
+
+void LogicExportData::add(int cell, float xpos, float ypos, float modsize) {
+  cells.push_back( cell );
+  x.push_back( xpos );
+  y.push_back( ypos );
+  size.push_back( modsize );
+  maxcell = (cell > maxcell) ? cell : maxcell;
+}
+
+void G4SBSWriter::format(const LogicExportData& data, std::string& out) const {
+  std::ostringstream logic_file;
+  logic_file << "# Units are in mm. ECal is shifted by +40 mm in y relative to previous output." << std::endl;
+  logic_file << "# Coordinates are relative to ECal center, same system as G4SBS" << std::endl;
+  logic_file << "# Number of logic patterns = " << data.groups() << std::endl;
+  logic_file << "# Type 42: " << data.count42 << std::endl;
+  logic_file << "# Type 40: " << data.count40 << std::endl;
+  logic_file << "# Type 38: " << data.count38 << std::endl;
+  logic_file << "# Total number of modules: " << data.count << std::endl;
+  logic_file << std::endl;
+  logic_file << std::setw(5) << "#cell" << std::setw(5) << "x" 
+	     << std::setw(5) << "y"    << std::setw(7) << "size" << std::endl; 
+
+  for( int g=0; g<data.groups(); g++ ) {
+    for( int k=data.groupstart[g]; k<data.groupstart[g+1]; k++ ) {
+      logic_file << std::setw(5) << data.cells[k] << std::setw(6) << data.x[k] 
+		 << std::setw(6) << data.y[k]     << std::setw(5) << data.size[k] << std::endl; 
+    }
+    logic_file << "######################" << std::endl;
+  }
+  out = logic_file.str();
+}
+
+void CSVWriter::format(const LogicExportData& data, std::string& out) const {
+  std::ostringstream csv;
+  csv << "group,cell,x,y,size" << std::endl;
+  for( int g=0; g<data.groups(); g++ ) {
+    for( int k=data.groupstart[g]; k<data.groupstart[g+1]; k++ ) {
+      csv << g+1 << ',' << data.cells[k] << ',' << data.x[k] << ','
+	  << data.y[k] << ',' << data.size[k] << std::endl;
+    }
+  }
+  out = csv.str();
+}
+
+namespace {
+  // 32 bit values as little endian bytes, whatever the host order
+  template <class T>
+  void append(std::string& out, const T* values, int n) {
+    for( int i=0; i<n; i++ ) {
+      uint32_t word;
+      memcpy( &word, &values[i], sizeof(word) );
+      char bytes[4] = { char(word), char(word >> 8), char(word >> 16), char(word >> 24) };
+      out.append( bytes, 4 );
+    }
+  }
+}
+
+void BinaryWriter::format(const LogicExportData& data, std::string& out) const {
+  int header[3] = { 1, data.groups(), int(data.cells.size()) };
+  out.assign( "ECLG" );
+  append( out, header, 3 );
+  int n = data.cells.size();
+  append( out, &data.groupstart[0], data.groupstart.size() );
+  if( n > 0 ) {
+    append( out, &data.cells[0], n );
+    append( out, &data.x[0], n );
+    append( out, &data.y[0], n );
+    append( out, &data.size[0], n );
+  }
+}
+
+void CellMaskWriter::format(const LogicExportData& data, std::string& out) const {
+  // Words are written most significant nibble first, pattern 0 is bit 0
+  int ngroups = data.groups();
+  int nibbles = ( ngroups + 3 ) / 4;
+  int lastcell = (data.layoutmaxcell > data.maxcell) ? data.layoutmaxcell : data.maxcell;
+  std::vector<unsigned char> masks( long(lastcell+1) * nibbles, 0 );
+  for( int g=0; g<ngroups; g++ ) {
+    for( int k=data.groupstart[g]; k<data.groupstart[g+1]; k++ ) {
+      masks[ long(data.cells[k]) * nibbles + g/4 ] |= 1 << (g % 4);
+    }
+  }
+
+  static const char hex[] = "0123456789abcdef";
+  std::ostringstream header;
+  header << "// cell -> logic pattern mask, " << ngroups << " bits, address = cell number" << std::endl;
+  out = header.str();
+  out.reserve( out.size() + long(lastcell+1) * (nibbles+1) );
+  for( int cell=0; cell<=lastcell; cell++ ) {
+    const unsigned char* m = &masks[0] + long(cell) * nibbles;
+    for( int k=nibbles-1; k>=0; k-- ) out += hex[ m[k] ];
+    out += '\n';
+  }
+}
+
+void GroupListWriter::format(const LogicExportData& data, std::string& out) const {
+  int ngroups = data.groups();
+  int widest = 0;
+  for( int g=0; g<ngroups; g++ ) {
+    int n = data.groupstart[g+1] - data.groupstart[g];
+    widest = (n > widest) ? n : widest;
+  }
+
+  std::ostringstream header;
+  header << "// logic pattern -> cells, " << widest << " x 12 bit cells after an 8 bit count, address = pattern" << std::endl;
+  out = header.str();
+  char word[8];
+  for( int g=0; g<ngroups; g++ ) {
+    int n = data.groupstart[g+1] - data.groupstart[g];
+    snprintf( word, sizeof(word), "%02x", n & 0xff );
+    out += word;
+    for( int k=0; k<widest; k++ ) {
+      int cell = ( k < n ) ? data.cells[ data.groupstart[g] + k ] : 0;
+      snprintf( word, sizeof(word), "%03x", cell & 0xfff );
+      out += word;
+    }
+    out += '\n';
+  }
+}
+
+LogicExporter::~LogicExporter() {
+  for( int w=0; w<int(writers.size()); w++ ) delete writers[w];
+}
+
+bool LogicExporter::run(const LogicExportData& data) const {
+  // Formatting is CPU bound and independent per writer, the writes
+  // themselves go out as one block per file
+  int nwriters = writers.size();
+  std::vector<char> ok( nwriters, 0 );
+  std::vector<std::thread> threads;
+  for( int w=0; w<nwriters; w++ ) {
+    const LogicWriter* writer = writers[w];
+    char* status = &ok[w];
+    threads.push_back( std::thread( [writer, status, &data]() {
+	  std::string buffer;
+	  writer->format( data, buffer );
+	  FILE* file = fopen( writer->filename().c_str(), "wb" );
+	  if( !file ) return;
+	  *status = fwrite( buffer.data(), 1, buffer.size(), file ) == buffer.size();
+	  *status &= fclose( file ) == 0;
+	} ) );
+  }
+  bool good = true;
+  for( int w=0; w<nwriters; w++ ) {
+    threads[w].join();
+    if( !ok[w] ) {
+      std::cerr << "Error writing " << writers[w]->filename() << std::endl;
+      good = false;
+    }
+  }
+  return good;
+}
@@ -0,0 +1,205 @@
+#include "../include/LogicIndex.hh"
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+LogicIndex::LogicIndex() {
+  ngroups = 0;
+  maxcellnumber = -1;
+  binsize = 20;
+  minx = miny = 0;
+  nbinx = nbiny = 0;
+  groupstart.assign( 1, 0 );
+  cellstart.assign( 1, 0 );
+  neighborstart.assign( 1, 0 );
+  binstart.assign( 1, 0 );
+}
+
+void LogicIndex::build(const LogicTable& logic, const Layout& layout) {
+  ngroups = logic.groups();
+  maxcellnumber = layout.maxcell();
+
+  // Pattern -> cells, copied straight from the table
+  groupstart.resize( ngroups+1 );
+  groupcells.clear();
+  for( int g=0; g<ngroups; g++ ) {
+    int n;
+    const int* cells = logic.group( g, n );
+    groupstart[g] = groupcells.size();
+    for( int k=0; k<n; k++ ) {
+      maxcellnumber = std::max( maxcellnumber, cells[k] );
+      groupcells.push_back( cells[k] );
+    }
+  }
+  groupstart[ngroups] = groupcells.size();
+
+  // Cell -> patterns by counting sort, patterns come out in order
+  cellstart.assign( maxcellnumber+2, 0 );
+  for( int k=0; k<int(groupcells.size()); k++ ) cellstart[ groupcells[k]+1 ]++;
+  for( int c=0; c<=maxcellnumber; c++ ) cellstart[c+1] += cellstart[c];
+  cellgroups.resize( groupcells.size() );
+  std::vector<int> fill( cellstart.begin(), cellstart.end()-1 );
+  for( int g=0; g<ngroups; g++ ) {
+    for( int k=groupstart[g]; k<groupstart[g+1]; k++ ) {
+      cellgroups[ fill[ groupcells[k] ]++ ] = g;
+    }
+  }
+
+  // Pattern -> overlapping patterns, deduplicated with a stamp per pattern
+  neighborstart.resize( ngroups+1 );
+  neighborgroups.clear();
+  std::vector<int> stamp( ngroups, -1 );
+  for( int g=0; g<ngroups; g++ ) {
+    neighborstart[g] = neighborgroups.size();
+    stamp[g] = g;
+    for( int k=groupstart[g]; k<groupstart[g+1]; k++ ) {
+      int c = groupcells[k];
+      for( int j=cellstart[c]; j<cellstart[c+1]; j++ ) {
+	int other = cellgroups[j];
+	if( stamp[other] == g ) continue;
+	stamp[other] = g;
+	neighborgroups.push_back( other );
+      }
+    }
+    std::sort( neighborgroups.begin() + neighborstart[g], neighborgroups.end() );
+  }
+  neighborstart[ngroups] = neighborgroups.size();
+
+  // Module grid for point lookups, each bin lists the modules touching
+  // it. Positions are taken as written in the logic file, once per cell.
+  modx.clear();
+  mody.clear();
+  modhalf.clear();
+  modcell.clear();
+  std::vector<char> seen( maxcellnumber+1, 0 );
+  for( int k=0; k<logic.entries(); k++ ) {
+    int cell = groupcells[k];
+    if( seen[cell] ) continue;
+    seen[cell] = 1;
+    modx.push_back( logic.x(k) );
+    mody.push_back( logic.y(k) );
+    modhalf.push_back( 0.5*logic.size(k) );
+    modcell.push_back( cell );
+  }
+  int nmod = modcell.size();
+  float maxx = 0, maxy = 0;
+  minx = miny = 0;
+  for( int i=0; i<nmod; i++ ) {
+    minx = std::min( minx, modx[i] - modhalf[i] );
+    miny = std::min( miny, mody[i] - modhalf[i] );
+    maxx = std::max( maxx, modx[i] + modhalf[i] );
+    maxy = std::max( maxy, mody[i] + modhalf[i] );
+  }
+  nbinx = int( (maxx - minx) / binsize ) + 1;
+  nbiny = int( (maxy - miny) / binsize ) + 1;
+  binstart.assign( nbinx*nbiny + 1, 0 );
+  std::vector<int> lo;
+  for( int pass=0; pass<2; pass++ ) {
+    for( int i=0; i<nmod; i++ ) {
+      int bx0 = int( (modx[i] - modhalf[i] - minx) / binsize );
+      int bx1 = std::min( nbinx-1, int( (modx[i] + modhalf[i] - minx) / binsize ) );
+      int by0 = int( (mody[i] - modhalf[i] - miny) / binsize );
+      int by1 = std::min( nbiny-1, int( (mody[i] + modhalf[i] - miny) / binsize ) );
+      for( int by=by0; by<=by1; by++ ) {
+	for( int bx=bx0; bx<=bx1; bx++ ) {
+	  int bin = by*nbinx + bx;
+	  if( pass == 0 ) binstart[bin+1]++;
+	  else binmodules[ lo[bin]++ ] = i;
+	}
+      }
+    }
+    if( pass == 0 ) {
+      for( int b=0; b<nbinx*nbiny; b++ ) binstart[b+1] += binstart[b];
+      binmodules.resize( binstart.back() );
+      lo.assign( binstart.begin(), binstart.end()-1 );
+    }
+  }
+}
+
+int LogicIndex::cellat(float x, float y) const {
+  int bx = int( floor( (x - minx) / binsize ) );
+  int by = int( floor( (y - miny) / binsize ) );
+  if( bx < 0 || bx >= nbinx || by < 0 || by >= nbiny ) return -1;
+  int bin = by*nbinx + bx;
+  for( int k=binstart[bin]; k<binstart[bin+1]; k++ ) {
+    int i = binmodules[k];
+    if( fabs( modx[i] - x ) <= modhalf[i] && fabs( mody[i] - y ) <= modhalf[i] ) return modcell[i];
+  }
+  return -1;
+}
+
+namespace {
+  // Length prefixed arrays, the same on load and save
+  template<class T>
+  bool writearray(FILE* out, const std::vector<T>& v) {
+    int n = v.size();
+    if( fwrite( &n, sizeof(int), 1, out ) != 1 ) return false;
+    return n == 0 || fwrite( &v[0], sizeof(T), n, out ) == size_t(n);
+  }
+  template<class T>
+  bool readarray(FILE* in, std::vector<T>& v) {
+    int n;
+    if( fread( &n, sizeof(int), 1, in ) != 1 || n < 0 ) return false;
+    v.resize( n );
+    return n == 0 || fread( &v[0], sizeof(T), n, in ) == size_t(n);
+  }
+}
+
+bool LogicIndex::save(const std::string& filename) const {
+  FILE* out = fopen( filename.c_str(), "wb" );
+  if( !out ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  int header[5] = { 2, ngroups, maxcellnumber, nbinx, nbiny };
+  float grid[3] = { binsize, minx, miny };
+  bool ok = fwrite( "ECLI", 1, 4, out ) == 4
+    && fwrite( header, sizeof(int), 5, out ) == 5
+    && fwrite( grid, sizeof(float), 3, out ) == 3
+    && writearray( out, groupstart ) && writearray( out, groupcells )
+    && writearray( out, cellstart ) && writearray( out, cellgroups )
+    && writearray( out, neighborstart ) && writearray( out, neighborgroups )
+    && writearray( out, modx ) && writearray( out, mody )
+    && writearray( out, modhalf ) && writearray( out, modcell )
+    && writearray( out, binstart ) && writearray( out, binmodules );
+  fclose( out );
+  if( !ok ) std::cerr << "Error writing " << filename << std::endl;
+  return ok;
+}
+
+bool LogicIndex::load(const std::string& filename) {
+  FILE* in = fopen( filename.c_str(), "rb" );
+  if( !in ) return false;
+  char magic[4];
+  int header[5];
+  float grid[3];
+  bool ok = fread( magic, 1, 4, in ) == 4
+    && std::equal( magic, magic+4, "ECLI" )
+    && fread( header, sizeof(int), 5, in ) == 5 && header[0] == 2
+    && fread( grid, sizeof(float), 3, in ) == 3
+    && readarray( in, groupstart ) && readarray( in, groupcells )
+    && readarray( in, cellstart ) && readarray( in, cellgroups )
+    && readarray( in, neighborstart ) && readarray( in, neighborgroups )
+    && readarray( in, modx ) && readarray( in, mody )
+    && readarray( in, modhalf ) && readarray( in, modcell )
+    && readarray( in, binstart ) && readarray( in, binmodules );
+  fclose( in );
+
+  // A short or mismatched file is rebuilt by the caller
+  ok = ok && int(groupstart.size()) == header[1]+1
+    && int(cellstart.size()) == header[2]+2
+    && int(binstart.size()) == header[3]*header[4]+1;
+  if( !ok ) {
+    *this = LogicIndex();
+    return false;
+  }
+  ngroups = header[1];
+  maxcellnumber = header[2];
+  nbinx = header[3];
+  nbiny = header[4];
+  binsize = grid[0];
+  minx = grid[1];
+  miny = grid[2];
+  return true;
+}
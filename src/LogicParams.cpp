@@ -0,0 +1,186 @@
+#include "../include/LogicParams.hh"
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cfloat>
+#include <thread>
+
+namespace {
+  // erf(x) for x >= 0 from Abramowitz & Stegun 7.1.27, |error| < 5e-4.
+  // Only multiplies and one divide, so it vectorises where std::erf does not.
+  inline float fasterf(float x) {
+    float t = 1 + x*(0.278393f + x*(0.230389f + x*(0.000972f + x*0.078108f)));
+    t = t*t;
+    return 1 - 1/(t*t);
+  }
+}
+
+bool LogicParams::read(const std::string& filename, int ngroups) {
+  std::ifstream params( filename.c_str() );
+  if( !params.is_open() ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  mean.clear();
+  sigma.clear();
+  threshold.clear();
+
+  float m, s, t;
+  while( params >> m >> s >> t ) {
+    mean.push_back( m );
+    sigma.push_back( s );
+    threshold.push_back( s > 0 ? t : FLT_MAX );
+  }
+  params.close();
+  refitted.assign( mean.size(), 0 );
+
+  // Rows are bound to patterns by position, so the counts have to agree
+  if( int(mean.size()) != ngroups ) {
+    std::cerr << filename << " has " << mean.size() << " rows for "
+	      << ngroups << " logic patterns" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool LogicParams::write(const std::string& filename) const {
+  std::ofstream params( filename.c_str() );
+  if( !params.is_open() ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  params << std::fixed;
+  for( int g=0; g<size(); g++ ) {
+    params << std::setprecision(2) << std::setw(8) << mean[g]
+	   << std::setprecision(3) << std::setw(10) << sigma[g]
+	   << std::setprecision(2) << std::setw(10) << ( fitted(g) ? threshold[g] : 0 ) << std::endl;
+  }
+  params.close();
+  return true;
+}
+
+void LogicParams::resize(int ngroups) {
+  mean.resize( ngroups, 0 );
+  sigma.resize( ngroups, 0 );
+  threshold.resize( ngroups, FLT_MAX );
+  refitted.resize( ngroups, 0 );
+}
+
+int LogicParams::passthreshold(const float* sums, int nevents, unsigned char* fired) const {
+  int ngroups = size();
+  const float* cut = &threshold[0];
+  int nfired = 0;
+  for( int ev=0; ev<nevents; ev++ ) {
+    const float* s = sums + long(ev)*ngroups;
+    unsigned char* f = fired + long(ev)*ngroups;
+    for( int g=0; g<ngroups; g++ ) {
+      f[g] = s[g] > cut[g];
+    }
+    for( int g=0; g<ngroups; g++ ) {
+      nfired += f[g];
+    }
+  }
+  return nfired;
+}
+
+void LogicParams::turnon(const float* sums, int nevents, float* response) const {
+  // Threshold smeared by the group sum resolution:
+  // 0.5*( 1 + erf( (sum - threshold) / (sqrt(2) sigma) ) )
+  int ngroups = size();
+  std::vector<float> scale( ngroups );
+  for( int g=0; g<ngroups; g++ ) {
+    scale[g] = ( sigma[g] > 0 ) ? 1.0/( sqrt(2.0)*sigma[g] ) : 1e6;
+  }
+  const float* cut = &threshold[0];
+  const float* k = &scale[0];
+  for( int ev=0; ev<nevents; ev++ ) {
+    const float* s = sums + long(ev)*ngroups;
+    float* r = response + long(ev)*ngroups;
+    for( int g=0; g<ngroups; g++ ) {
+      float u = ( s[g] - cut[g] ) * k[g];
+      float e = fasterf( fabsf(u) );
+      r[g] = 0.5f + ( u < 0 ? -0.5f : 0.5f ) * e;
+    }
+  }
+}
+
+void LogicParams::fit(const std::vector<float>& sums, int nthreads, float nsigma, int minentries) {
+  // Each event is credited to the pattern with the largest sum, i.e. the
+  // one the shower is centred on. The peak of that pattern's spectrum is
+  // found with an iterated +-2 sigma truncated mean and RMS; 0.8796 is
+  // the RMS of a unit Gaussian truncated at +-2. Patterns with fewer
+  // than minentries showers keep their rows.
+  int ngroups = size();
+  if( ngroups == 0 ) return;
+  int nevents = sums.size() / ngroups;
+  if( nthreads < 1 ) nthreads = 1;
+
+  std::vector<int> best( nevents );
+  std::vector<std::thread> workers;
+  for( int t=0; t<nthreads; t++ ) {
+    int first = ( long(nevents) * t ) / nthreads;
+    int last  = ( long(nevents) * (t+1) ) / nthreads;
+    workers.push_back( std::thread( [=, &sums, &best]() {
+	  for( int ev=first; ev<last; ev++ ) {
+	    const float* s = &sums[0] + long(ev)*ngroups;
+	    int imax = 0;
+	    for( int g=1; g<ngroups; g++ ) {
+	      if( s[g] > s[imax] ) imax = g;
+	    }
+	    best[ev] = imax;
+	  }
+	} ) );
+  }
+  for( int t=0; t<nthreads; t++ ) workers[t].join();
+  workers.clear();
+
+  // Counting sort of the winning sums by pattern
+  std::vector<int> start( ngroups+1, 0 );
+  for( int ev=0; ev<nevents; ev++ ) start[ best[ev]+1 ]++;
+  for( int g=0; g<ngroups; g++ ) start[g+1] += start[g];
+  std::vector<float> values( nevents );
+  std::vector<int> fill( start.begin(), start.end()-1 );
+  for( int ev=0; ev<nevents; ev++ ) {
+    values[ fill[ best[ev] ]++ ] = sums[ long(ev)*ngroups + best[ev] ];
+  }
+
+  for( int t=0; t<nthreads; t++ ) {
+    workers.push_back( std::thread( [=, &start, &values]() {
+	  for( int g=t; g<ngroups; g+=nthreads ) {
+	    int n = start[g+1] - start[g];
+	    if( n < minentries ) continue;
+	    const float* v = &values[0] + start[g];
+
+	    double sum = 0, sum2 = 0;
+	    for( int i=0; i<n; i++ ) {
+	      sum += v[i];
+	      sum2 += v[i]*v[i];
+	    }
+	    double m = sum/n;
+	    double s = sqrt( fabs( sum2/n - m*m ) );
+	    for( int iter=0; iter<10 && s > 0; iter++ ) {
+	      double lo = m - 2*s, hi = m + 2*s;
+	      int nin = 0;
+	      sum = 0;
+	      sum2 = 0;
+	      for( int i=0; i<n; i++ ) {
+		if( v[i] < lo || v[i] > hi ) continue;
+		nin++;
+		sum += v[i];
+		sum2 += v[i]*v[i];
+	      }
+	      if( nin < 2 ) break;
+	      m = sum/nin;
+	      s = sqrt( fabs( sum2/nin - m*m ) ) / 0.8796;
+	    }
+	    if( !( s > 0 ) ) continue;
+	    mean[g] = m;
+	    sigma[g] = s;
+	    threshold[g] = m - nsigma*s;
+	    refitted[g] = 1;
+	  }
+	} ) );
+  }
+  for( int t=0; t<nthreads; t++ ) workers[t].join();
+}
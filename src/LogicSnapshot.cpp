@@ -0,0 +1,148 @@
+#include "../include/LogicSnapshot.hh"
+
+#include <algorithm>
+
+LogicSnapshot::LogicSnapshot(const std::shared_ptr<const LogicModules>& modules,
+			     int cells, float modulesize) {
+  table = modules;
+  nodeset = std::make_shared<const std::vector<int> >();
+  excluded = std::make_shared<const std::vector<int> >();
+  grouplist = std::make_shared<const std::vector<Group> >();
+  maxcells = cells;
+  size = modulesize;
+}
+
+LogicSnapshot::Group LogicSnapshot::find(int node) const {
+  // Groups are stored in node order
+  std::vector<int>::const_iterator it = std::lower_bound( nodeset->begin(), nodeset->end(), node );
+  if( it == nodeset->end() || *it != node ) return Group();
+  return (*grouplist)[ it - nodeset->begin() ];
+}
+
+LogicSnapshot LogicSnapshot::rebuild(LogicBuilder& builder,
+				     const std::shared_ptr<const std::vector<int> >& chosen,
+				     const std::shared_ptr<const std::vector<int> >& cut) const {
+  // Regrow every group from the modules left after the exclusions. The
+  // build is cheap, storing it is not: a group that came out the same
+  // as before is shared with this snapshot instead of copied.
+  const LogicModules& mods = *table;
+  std::vector<int> cells;
+  std::vector<float> x, y;
+  for( int i=0; i<int(mods.cells.size()); i++ ) {
+    if( std::binary_search( cut->begin(), cut->end(), mods.cells[i] ) ) continue;
+    cells.push_back( mods.cells[i] );
+    x.push_back( mods.x[i] );
+    y.push_back( mods.y[i] );
+  }
+  std::vector<float> nodex, nodey;
+  for( int k=0; k<int(chosen->size()); k++ ) {
+    nodex.push_back( mods.nodex[ (*chosen)[k] ] );
+    nodey.push_back( mods.nodey[ (*chosen)[k] ] );
+  }
+
+  std::shared_ptr<std::vector<Group> > list = std::make_shared<std::vector<Group> >();
+  if( !cells.empty() && !nodex.empty() ) {
+    builder.setmodules( &cells[0], &x[0], &y[0], cells.size() );
+    builder.build( &nodex[0], &nodey[0], nodex.size(), maxcells, size );
+  }
+  for( int g=0; g<int(chosen->size()); g++ ) {
+    int n = 0;
+    const int* grown = (g < builder.groups() && !cells.empty()) ? builder.group( g, n ) : 0;
+    Group old = find( (*chosen)[g] );
+    if( old && int(old->cells.size()) == n && std::equal( grown, grown + n, old->cells.begin() ) ) {
+      list->push_back( old );
+      continue;
+    }
+    std::shared_ptr<LogicGroup> fresh = std::make_shared<LogicGroup>();
+    fresh->node = (*chosen)[g];
+    fresh->cells.assign( grown, grown + n );
+    list->push_back( fresh );
+  }
+
+  LogicSnapshot next( *this );
+  next.nodeset = chosen;
+  next.excluded = cut;
+  next.grouplist = list;
+  return next;
+}
+
+LogicSnapshot LogicSnapshot::withnodes(LogicBuilder& builder, const std::vector<int>& chosen) const {
+  std::vector<int> sorted;
+  for( int k=0; k<int(chosen.size()); k++ ) {
+    if( chosen[k] >= 0 && chosen[k] < int(table->nodex.size()) ) sorted.push_back( chosen[k] );
+  }
+  std::sort( sorted.begin(), sorted.end() );
+  sorted.erase( std::unique( sorted.begin(), sorted.end() ), sorted.end() );
+  return rebuild( builder, std::make_shared<const std::vector<int> >( sorted ), excluded );
+}
+
+LogicSnapshot LogicSnapshot::togglenode(LogicBuilder& builder, int node) const {
+  if( node < 0 || node >= int(table->nodex.size()) ) return *this;
+  std::vector<int> chosen( *nodeset );
+  std::vector<int>::iterator it = std::lower_bound( chosen.begin(), chosen.end(), node );
+  if( it != chosen.end() && *it == node ) chosen.erase( it );
+  else chosen.insert( it, node );
+  return rebuild( builder, std::make_shared<const std::vector<int> >( chosen ), excluded );
+}
+
+LogicSnapshot LogicSnapshot::togglecell(LogicBuilder& builder, int cell) const {
+  if( !std::binary_search( table->cells.begin(), table->cells.end(), cell ) ) return *this;
+  std::vector<int> cut( *excluded );
+  std::vector<int>::iterator it = std::lower_bound( cut.begin(), cut.end(), cell );
+  if( it != cut.end() && *it == cell ) cut.erase( it );
+  else cut.insert( it, cell );
+  return rebuild( builder, nodeset, std::make_shared<const std::vector<int> >( cut ) );
+}
+
+bool LogicSnapshot::same(const LogicSnapshot& other) const {
+  return table == other.table && nodeset == other.nodeset &&
+    excluded == other.excluded && grouplist == other.grouplist;
+}
+
+int LogicSnapshot::shared(const LogicSnapshot& other) const {
+  int n = 0;
+  if( !grouplist || !other.grouplist ) return 0;
+  for( int g=0; g<groups(); g++ ) {
+    if( other.find( (*nodeset)[g] ) == (*grouplist)[g] ) n++;
+  }
+  return n;
+}
+
+void LogicHistory::reset(const LogicSnapshot& start) {
+  now = start;
+  other = start;
+  undos.clear();
+  redos.clear();
+}
+
+bool LogicHistory::edit(const LogicSnapshot& next) {
+  if( next.same( now ) ) return false;
+  undos.push_back( now );
+  redos.clear();
+  now = next;
+  return true;
+}
+
+bool LogicHistory::undo() {
+  if( undos.empty() ) return false;
+  redos.push_back( now );
+  now = undos.back();
+  undos.pop_back();
+  return true;
+}
+
+bool LogicHistory::redo() {
+  if( redos.empty() ) return false;
+  undos.push_back( now );
+  now = redos.back();
+  redos.pop_back();
+  return true;
+}
+
+bool LogicHistory::swap() {
+  if( !other.valid() ) return false;
+  LogicSnapshot previous = now;
+  if( !edit( other ) ) return false;
+  other = previous;
+  return true;
+}
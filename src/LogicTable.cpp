@@ -0,0 +1,72 @@
+#include "../include/LogicTable.hh"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+bool LogicTable::read(const std::string& filename) {
+  std::ifstream logic( filename.c_str() );
+  if( !logic.is_open() ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+
+  groupstart.clear();
+  cells.clear();
+  xpos.clear();
+  ypos.clear();
+  sizes.clear();
+  moduleindex.clear();
+
+  // Header lines start with '#' as well, only a row of '#' closes a pattern
+  std::string line;
+  groupstart.push_back( 0 );
+  while( std::getline( logic, line ) ) {
+    if( line.compare( 0, 5, "#####" ) == 0 ) {
+      groupstart.push_back( cells.size() );
+      continue;
+    }
+    if( line.empty() || line[0] == '#' ) continue;
+
+    int cell;
+    float x, y, size;
+    std::stringstream first(line);
+    if( first >> cell >> x >> y >> size ) {
+      cells.push_back( cell );
+      xpos.push_back( x );
+      ypos.push_back( y );
+      sizes.push_back( size );
+    }
+  }
+  logic.close();
+
+  // Cells after the last separator still make a pattern
+  if( groupstart.back() != int(cells.size()) ) {
+    groupstart.push_back( cells.size() );
+  }
+  return true;
+}
+
+bool LogicTable::bind(const Layout& layout) {
+  bool ok = true;
+  moduleindex.resize( cells.size() );
+  for( int i=0; i<int(cells.size()); i++ ) {
+    moduleindex[i] = layout.index( cells[i] );
+    if( moduleindex[i] < 0 ) {
+      std::cerr << "Logic cell " << cells[i] << " is not in the layout" << std::endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void LogicTable::groupsums(const float* energy, float* sums) const {
+  int ngroups = groups();
+  for( int g=0; g<ngroups; g++ ) {
+    float sum = 0;
+    for( int k=groupstart[g]; k<groupstart[g+1]; k++ ) {
+      int mod = moduleindex[k];
+      if( mod >= 0 ) sum += energy[mod];
+    }
+    sums[g] = sum;
+  }
+}
@@ -0,0 +1,233 @@
+#include "../include/Profiler.hh"
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+namespace {
+  struct Record {
+    const char* name;
+    long long start, end;   // end < 0 marks a counter, start is then the value
+    long long time;
+  };
+
+  const int kRingSize = 1 << 16;
+
+  // One per thread, registered the first time the thread records. Only
+  // the owning thread writes records; it publishes them by storing
+  // written with release order, readers load it with acquire order.
+  struct ThreadRing {
+    std::vector<Record> records;
+    std::atomic<long long> written, cleared;
+    int tid;
+  };
+
+  // What was left in the ring of a thread that has exited
+  struct Retired {
+    int tid;
+    std::vector<Record> records;
+  };
+
+  std::mutex ringlock;
+  std::vector<ThreadRing*> rings;
+  std::vector<Retired> retired;
+  int nthreads = 0;
+  long long origin = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		       std::chrono::steady_clock::now().time_since_epoch() ).count();
+
+  // Records still held in a ring, oldest first. If the owner is live it
+  // may be writing while we copy; whatever it overwrote is dropped.
+  void collect(const ThreadRing* ring, std::vector<Record>& out, bool live) {
+    long long written = ring->written.load( std::memory_order_acquire );
+    long long first = ( written > kRingSize ) ? written - kRingSize : 0;
+    long long cleared = ring->cleared.load( std::memory_order_relaxed );
+    first = ( cleared > first ) ? cleared : first;
+    size_t base = out.size();
+    for( long long i=first; i<written; i++ ) {
+      out.push_back( ring->records[ i % kRingSize ] );
+    }
+    std::atomic_thread_fence( std::memory_order_acquire );
+    long long now = ring->written.load( std::memory_order_relaxed );
+    long long lost = now + (live ? 1 : 0) - kRingSize - first;
+    if( lost > 0 ) {
+      out.erase( out.begin() + base, out.begin() + base + std::min( lost, written - first ) );
+    }
+  }
+
+  // Keep what the thread recorded, free its ring
+  void retire(ThreadRing* ring) {
+    std::lock_guard<std::mutex> guard( ringlock );
+    Retired r;
+    r.tid = ring->tid;
+    collect( ring, r.records, false );
+    if( !r.records.empty() ) retired.push_back( r );
+    rings.erase( std::find( rings.begin(), rings.end(), ring ) );
+    delete ring;
+  }
+
+  struct RingOwner {
+    ThreadRing* ring;
+    RingOwner() : ring(0) {}
+    ~RingOwner() { if( ring ) retire( ring ); }
+  };
+
+  ThreadRing* threadring() {
+    thread_local RingOwner owner;
+    if( !owner.ring ) {
+      ThreadRing* ring = new ThreadRing;
+      ring->records.resize( kRingSize );
+      ring->written.store( 0 );
+      ring->cleared.store( 0 );
+      std::lock_guard<std::mutex> guard( ringlock );
+      ring->tid = nthreads++;
+      rings.push_back( ring );
+      owner.ring = ring;
+    }
+    return owner.ring;
+  }
+
+  void push(const Record& rec) {
+    ThreadRing* ring = threadring();
+    long long w = ring->written.load( std::memory_order_relaxed );
+    ring->records[ w % kRingSize ] = rec;
+    ring->written.store( w+1, std::memory_order_release );
+  }
+
+  // Records of every thread, live or exited, with the thread ids
+  void gather(std::vector<int>& tids, std::vector<std::vector<Record> >& lists) {
+    std::lock_guard<std::mutex> guard( ringlock );
+    for( int r=0; r<int(rings.size()); r++ ) {
+      tids.push_back( rings[r]->tid );
+      lists.push_back( std::vector<Record>() );
+      collect( rings[r], lists.back(), true );
+    }
+    for( int r=0; r<int(retired.size()); r++ ) {
+      tids.push_back( retired[r].tid );
+      lists.push_back( retired[r].records );
+    }
+  }
+}
+
+std::atomic<bool> Profiler::enabled( false );
+
+void Profiler::enable(bool flag) {
+  enabled.store( flag );
+}
+
+long long Profiler::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+	   std::chrono::steady_clock::now().time_since_epoch() ).count() - origin;
+}
+
+void Profiler::record(const char* name, long long start, long long end) {
+  Record rec;
+  rec.name = name;
+  rec.start = start;
+  rec.end = end;
+  rec.time = start;
+  push( rec );
+}
+
+void Profiler::counter(const char* name, long long value) {
+  Record rec;
+  rec.name = name;
+  rec.start = value;
+  rec.end = -1;
+  rec.time = now();
+  push( rec );
+}
+
+bool Profiler::writetrace(const std::string& filename) {
+  // Chrome trace event format, load in chrome://tracing or Perfetto.
+  // Timestamps are in microseconds.
+  std::ofstream trace( filename.c_str() );
+  if( !trace.is_open() ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  std::vector<int> tids;
+  std::vector<std::vector<Record> > lists;
+  gather( tids, lists );
+  trace << "{\"traceEvents\":[" << std::endl;
+  trace << std::fixed << std::setprecision(3);
+  bool first = true;
+  for( int r=0; r<int(lists.size()); r++ ) {
+    const std::vector<Record>& records = lists[r];
+    for( int i=0; i<int(records.size()); i++ ) {
+      const Record& rec = records[i];
+      if( !first ) trace << "," << std::endl;
+      first = false;
+      if( rec.end < 0 ) {
+	trace << "{\"name\":\"" << rec.name << "\",\"ph\":\"C\",\"pid\":1,\"tid\":" << tids[r]
+	      << ",\"ts\":" << rec.time*1e-3 << ",\"args\":{\"value\":" << rec.start << "}}";
+      }
+      else {
+	trace << "{\"name\":\"" << rec.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tids[r]
+	      << ",\"ts\":" << rec.start*1e-3 << ",\"dur\":" << (rec.end-rec.start)*1e-3 << "}";
+      }
+    }
+  }
+  trace << std::endl << "]}" << std::endl;
+  trace.close();
+  return true;
+}
+
+void Profiler::summary(std::ostream& out) {
+  struct Total {
+    long long calls, sum, max;
+  };
+  std::map<std::string, Total> totals;
+  std::map<std::string, long long> counters;
+  std::map<std::string, Total>::iterator tit;
+  std::map<std::string, long long>::iterator cit;
+
+  std::vector<int> tids;
+  std::vector<std::vector<Record> > lists;
+  gather( tids, lists );
+  for( int r=0; r<int(lists.size()); r++ ) {
+    const std::vector<Record>& records = lists[r];
+    for( int i=0; i<int(records.size()); i++ ) {
+      const Record& rec = records[i];
+      if( rec.end < 0 ) {
+	counters[ rec.name ] = rec.start;
+	continue;
+      }
+      long long dt = rec.end - rec.start;
+      tit = totals.find( rec.name );
+      if( tit == totals.end() ) {
+	Total t = { 0, 0, 0 };
+	tit = totals.insert( std::make_pair( std::string(rec.name), t ) ).first;
+      }
+      tit->second.calls++;
+      tit->second.sum += dt;
+      tit->second.max = (dt > tit->second.max) ? dt : tit->second.max;
+    }
+  }
+
+  out << std::setw(32) << std::left << "#stage" << std::right << std::setw(8) << "calls"
+      << std::setw(14) << "total(ms)" << std::setw(14) << "mean(us)" << std::setw(14) << "max(us)" << std::endl;
+  out << std::fixed << std::setprecision(3);
+  for( tit = totals.begin(); tit != totals.end(); tit++ ) {
+    const Total& t = tit->second;
+    out << std::setw(32) << std::left << tit->first << std::right << std::setw(8) << t.calls
+	<< std::setw(14) << t.sum*1e-6 << std::setw(14) << t.sum*1e-3/t.calls
+	<< std::setw(14) << t.max*1e-3 << std::endl;
+  }
+  for( cit = counters.begin(); cit != counters.end(); cit++ ) {
+    out << std::setw(32) << std::left << cit->first << std::right << std::setw(8) << cit->second << std::endl;
+  }
+  out.unsetf( std::ios::fixed );
+}
+
+void Profiler::clear() {
+  std::lock_guard<std::mutex> guard( ringlock );
+  // The owners keep writing, so only move the start of each ring
+  for( int r=0; r<int(rings.size()); r++ ) {
+    rings[r]->cleared.store( rings[r]->written.load( std::memory_order_acquire ) );
+  }
+  retired.clear();
+}
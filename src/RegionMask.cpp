@@ -0,0 +1,206 @@
+#include "../include/RegionMask.hh"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+
+RegionMask::RegionMask(int maxcell) {
+  nbits = maxcell + 1;
+  words.assign( (nbits + 63) / 64, 0ULL );
+}
+
+RegionMask RegionMask::all(const Layout& layout) {
+  RegionMask mask( layout.maxcell() );
+  for( int i=0; i<layout.size(); i++ ) mask.set( layout.module(i).cell );
+  return mask;
+}
+
+RegionMask RegionMask::perimeter(const Layout& layout, int depth) {
+  // The outer depth modules of every row and column. This uses the
+  // row/col/ncol numbering, so the first and last module of each row is
+  // on the edge even where the crescent steps in or out.
+  RegionMask mask( layout.maxcell() );
+  int maxrow = layout.rows();
+  for( int i=0; i<layout.size(); i++ ) {
+    const Module& mod = layout.module(i);
+    if( mod.row <= depth || mod.row > maxrow - depth ||
+	mod.col <= depth || mod.col > mod.ncol - depth ) {
+      mask.set( mod.cell );
+    }
+  }
+  return mask;
+}
+
+RegionMask RegionMask::rows(const Layout& layout, int first, int last) {
+  RegionMask mask( layout.maxcell() );
+  for( int i=0; i<layout.size(); i++ ) {
+    const Module& mod = layout.module(i);
+    if( mod.row >= first && mod.row <= last ) mask.set( mod.cell );
+  }
+  return mask;
+}
+
+RegionMask RegionMask::columns(const Layout& layout, int first, int last) {
+  RegionMask mask( layout.maxcell() );
+  for( int i=0; i<layout.size(); i++ ) {
+    const Module& mod = layout.module(i);
+    if( mod.col >= first && mod.col <= last ) mask.set( mod.cell );
+  }
+  return mask;
+}
+
+RegionMask RegionMask::polygon(const Layout& layout, const std::vector<float>& px, const std::vector<float>& py) {
+  // Modules whose center is inside the polygon (even-odd rule), vertices
+  // in layout coordinates (mm)
+  RegionMask mask( layout.maxcell() );
+  int n = px.size();
+  for( int i=0; i<layout.size(); i++ ) {
+    const Module& mod = layout.module(i);
+    bool inside = false;
+    for( int a=0, b=n-1; a<n; b=a++ ) {
+      if( ( py[a] > mod.y ) != ( py[b] > mod.y ) &&
+	  mod.x < px[a] + ( px[b]-px[a] ) * ( mod.y-py[a] ) / ( py[b]-py[a] ) ) {
+	inside = !inside;
+      }
+    }
+    if( inside ) mask.set( mod.cell );
+  }
+  return mask;
+}
+
+RegionMask RegionMask::list(const Layout& layout, const int* cells, int n) {
+  RegionMask mask( layout.maxcell() );
+  for( int k=0; k<n; k++ ) {
+    if( layout.index( cells[k] ) >= 0 ) mask.set( cells[k] );
+    else std::cerr << "Region cell " << cells[k] << " is not in the layout" << std::endl;
+  }
+  return mask;
+}
+
+bool RegionMask::parse(const Layout& layout, const std::string& text, RegionMask& result) {
+  // Rules combined left to right with + (union), & (intersection) and
+  // - (difference):
+  //   all | ring <depth> | rows <first> <last> | cols <first> <last>
+  //   cells <c1> <c2> ... ; | polygon <x1> <y1> <x2> <y2> ... ; | file <name>
+  // e.g. "all - ring 1 - cells 34 35 43 ;"
+  std::stringstream in( text );
+  std::string word;
+  char op = '+';
+  result = RegionMask( layout.maxcell() );
+
+  while( in >> word ) {
+    if( word == "+" || word == "&" || word == "-" ) {
+      op = word[0];
+      continue;
+    }
+    RegionMask term;
+    if( word == "all" ) {
+      term = all( layout );
+    }
+    else if( word == "ring" ) {
+      int depth = 0;
+      in >> depth;
+      term = perimeter( layout, depth );
+    }
+    else if( word == "rows" || word == "cols" ) {
+      int first = 0, last = 0;
+      in >> first >> last;
+      term = ( word == "rows" ) ? rows( layout, first, last ) : columns( layout, first, last );
+    }
+    else if( word == "cells" || word == "polygon" || word == "file" ) {
+      std::vector<int> cells;
+      std::vector<float> values;
+      std::string item;
+      if( word == "file" ) {
+	// one cell per line, like TE_layout_oct13.txt
+	in >> item;
+	std::ifstream list( item.c_str() );
+	if( !list.is_open() ) {
+	  std::cerr << "Error opening " << item << std::endl;
+	  return false;
+	}
+	int cell;
+	while( list >> cell ) cells.push_back( cell );
+      }
+      else {
+	while( in >> item && item != ";" ) values.push_back( atof( item.c_str() ) );
+      }
+      if( word == "polygon" ) {
+	std::vector<float> px, py;
+	for( int k=0; k+1<int(values.size()); k+=2 ) {
+	  px.push_back( values[k] );
+	  py.push_back( values[k+1] );
+	}
+	term = polygon( layout, px, py );
+      }
+      else {
+	for( int k=0; k<int(values.size()); k++ ) cells.push_back( int(values[k]) );
+	term = list( layout, cells.empty() ? 0 : &cells[0], cells.size() );
+      }
+    }
+    else {
+      std::cerr << "Unknown region rule '" << word << "'" << std::endl;
+      return false;
+    }
+
+    if( op == '+' ) result |= term;
+    if( op == '&' ) result &= term;
+    if( op == '-' ) result -= term;
+  }
+  return true;
+}
+
+int RegionMask::count() const {
+  int n = 0;
+  for( int w=0; w<int(words.size()); w++ ) n += __builtin_popcountll( words[w] );
+  return n;
+}
+
+void RegionMask::cells(std::vector<int>& out) const {
+  out.clear();
+  for( int w=0; w<int(words.size()); w++ ) {
+    unsigned long long bits = words[w];
+    while( bits ) {
+      out.push_back( 64*w + __builtin_ctzll( bits ) );
+      bits &= bits - 1;
+    }
+  }
+}
+
+bool RegionMask::write(const std::string& filename) const {
+  std::ofstream output( filename.c_str() );
+  if( !output.is_open() ) {
+    std::cerr << "Error opening " << filename << std::endl;
+    return false;
+  }
+  std::vector<int> list;
+  cells( list );
+  for( int k=0; k<int(list.size()); k++ ) output << list[k] << std::endl;
+  output.close();
+  return true;
+}
+
+// Masks from different layouts may differ in size, the result keeps the
+// size of the left hand side
+RegionMask& RegionMask::operator|=(const RegionMask& other) {
+  int n = ( words.size() < other.words.size() ) ? words.size() : other.words.size();
+  for( int w=0; w<n; w++ ) words[w] |= other.words[w];
+  return *this;
+}
+
+RegionMask& RegionMask::operator&=(const RegionMask& other) {
+  int n = ( words.size() < other.words.size() ) ? words.size() : other.words.size();
+  for( int w=0; w<n; w++ ) words[w] &= other.words[w];
+  for( int w=n; w<int(words.size()); w++ ) words[w] = 0;
+  return *this;
+}
+
+RegionMask& RegionMask::operator-=(const RegionMask& other) {
+  int n = ( words.size() < other.words.size() ) ? words.size() : other.words.size();
+  for( int w=0; w<n; w++ ) words[w] &= ~other.words[w];
+  return *this;
+}
+
+bool RegionMask::operator==(const RegionMask& other) const {
+  return nbits == other.nbits && words == other.words;
+}
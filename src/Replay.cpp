@@ -0,0 +1,238 @@
+#include "../include/Replay.hh"
+#include <sstream>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <map>
+
+Replay::Replay(const ECal& cal, float maxenergy, float threshold,
+	       const std::string& paramfile, const std::string& paramlogic) {
+  ecal = &cal;
+  emax = maxenergy;
+  havepending = false;
+  endoffile = false;
+  stopping = false;
+  loop = true;
+  shown = 0;
+
+  // One quad per module, 1 mm inside the module for the mylar
+  const Layout& table = ecal->moduletable();
+  const std::map<int,sf::RectangleShape>& modmap = ecal->modulemap();
+  int nmodules = table.size();
+  heatmap = sf::VertexArray( sf::Quads, 4*nmodules );
+  for( int i=0; i<nmodules; i++ ) {
+    std::map<int,sf::RectangleShape>::const_iterator mod = modmap.find( table.module(i).cell );
+    if( mod == modmap.end() ) continue;
+    sf::Vector2f pos = mod->second.getPosition();
+    float half = 0.5*mod->second.getSize().x - 1.0;
+    heatmap[4*i+0].position = sf::Vector2f( pos.x - half, pos.y - half );
+    heatmap[4*i+1].position = sf::Vector2f( pos.x + half, pos.y - half );
+    heatmap[4*i+2].position = sf::Vector2f( pos.x + half, pos.y + half );
+    heatmap[4*i+3].position = sf::Vector2f( pos.x - half, pos.y + half );
+    for( int v=0; v<4; v++ ) heatmap[4*i+v].color = sf::Color::Black;
+  }
+
+  // Patterns as built by the viewer
+  const std::vector<std::map<int,sf::RectangleShape> >& logic = ecal->logic();
+  groupstart.push_back( 0 );
+  for( int g=0; g<int(logic.size()); g++ ) {
+    std::map<int,sf::RectangleShape>::const_iterator it;
+    for( it = logic[g].begin(); it != logic[g].end(); it++ ) {
+      int index = table.index( it->first );
+      if( index >= 0 ) groupmodules.push_back( index );
+    }
+    groupstart.push_back( groupmodules.size() );
+  }
+
+  // Per-pattern thresholds. The table rows belong to the patterns of
+  // paramlogic by position, so each viewer pattern is looked up by its
+  // cell set there rather than by its own index.
+  int ngroups = logic.size();
+  thresholds.assign( ngroups, threshold );
+  LogicTable tablelogic;
+  LogicParams params;
+  int matched = 0;
+  if( tablelogic.read( paramlogic ) && params.read( paramfile, tablelogic.groups() ) ) {
+    std::map<std::vector<int>, int> rows;
+    for( int p=0; p<tablelogic.groups(); p++ ) {
+      int n;
+      const int* cells = tablelogic.group( p, n );
+      std::vector<int> key( cells, cells + n );
+      std::sort( key.begin(), key.end() );
+      rows[key] = p;
+    }
+    for( int g=0; g<ngroups; g++ ) {
+      std::vector<int> key;
+      std::map<int,sf::RectangleShape>::const_iterator it;
+      for( it = logic[g].begin(); it != logic[g].end(); it++ ) key.push_back( it->first );
+      std::map<std::vector<int>, int>::const_iterator row = rows.find( key );
+      if( row == rows.end() || !params.fitted( row->second ) ) continue;
+      thresholds[g] = params.cut( row->second );
+      matched++;
+    }
+  }
+  std::cout << matched << " of " << ngroups << " patterns use thresholds from " << paramfile
+	    << ", the rest " << threshold << " MeV" << std::endl;
+
+  // Black - blue - cyan - yellow - red colour scale
+  for( int k=0; k<256; k++ ) {
+    float f = k / 255.0;
+    float r = std::min( 1.0f, std::max( 0.0f, 3.0f*f - 1.5f ) );
+    float g = std::min( 1.0f, std::max( 0.0f, 3.0f*f - 0.5f ) ) - std::max( 0.0f, 3.0f*f - 2.5f )*2;
+    float b = std::min( 1.0f, 3.0f*f ) - std::max( 0.0f, 3.0f*f - 1.5f );
+    palette.push_back( sf::Color( 255*r, 255*std::max( 0.0f, g ), 255*std::max( 0.0f, b ) ) );
+  }
+
+  if( !font.loadFromFile("fonts/arial.ttf") ) {
+    std::cerr << "ERROR: Font did not load properly." << std::endl;
+  }
+  status.setFont( font );
+  status.setCharacterSize( 40 );
+  status.setColor( sf::Color::White );
+  sf::FloatRect bounds = heatmap.getBounds();
+  status.setPosition( bounds.left, bounds.top - 60 );
+
+  // Group sums at the centre of their patterns
+  sf::Text label;
+  label.setFont( font );
+  label.setCharacterSize( 24 );
+  label.setColor( sf::Color::White );
+  for( int g=0; g<ngroups; g++ ) {
+    float x = 0, y = 0;
+    int n = groupstart[g+1] - groupstart[g];
+    for( int k=groupstart[g]; k<groupstart[g+1]; k++ ) {
+      const sf::Vertex* quad = &heatmap[ 4*groupmodules[k] ];
+      x += 0.5 * ( quad[0].position.x + quad[2].position.x );
+      y += 0.5 * ( quad[0].position.y + quad[2].position.y );
+    }
+    if( n > 0 ) label.setPosition( x/n, y/n );
+    sumtext.push_back( label );
+  }
+}
+
+Replay::~Replay() {
+  {
+    std::lock_guard<std::mutex> guard( lock );
+    stopping = true;
+  }
+  wake.notify_all();
+  if( loader.joinable() ) loader.join();
+}
+
+bool Replay::open(const std::string& filename, bool repeat) {
+  if( !reader.open( filename ) ) return false;
+  loop = repeat;
+  loader = std::thread( &Replay::load, this );
+  return true;
+}
+
+void Replay::fill(const Event& event, std::vector<float>& energy, Frame& frame) const {
+  const Layout& table = ecal->moduletable();
+  int nmodules = table.size();
+  energy.assign( nmodules, 0 );
+  frame.id = event.id;
+  frame.total = 0;
+  for( int k=0; k<int(event.cells.size()); k++ ) {
+    int index = table.index( event.cells[k] );
+    if( index < 0 ) continue;
+    energy[index] += event.energy[k];
+    frame.total += event.energy[k];
+  }
+
+  frame.colors.resize( nmodules );
+  for( int i=0; i<nmodules; i++ ) {
+    int k = int( 255 * energy[i] / emax );
+    frame.colors[i] = palette[ k < 0 ? 0 : ( k > 255 ? 255 : k ) ];
+  }
+
+  int ngroups = int(groupstart.size()) - 1;
+  frame.sums.resize( ngroups );
+  frame.fired.clear();
+  for( int g=0; g<ngroups; g++ ) {
+    float sum = 0;
+    for( int k=groupstart[g]; k<groupstart[g+1]; k++ ) sum += energy[ groupmodules[k] ];
+    frame.sums[g] = sum;
+    if( sum > thresholds[g] ) frame.fired.push_back( g );
+  }
+}
+
+void Replay::load() {
+  // Loader thread: keep the pending frame filled
+  Event event;
+  std::vector<float> energy;
+  Frame next;
+  while( true ) {
+    bool ok = reader.next( event );
+    if( !ok && loop && reader.rewind() ) ok = reader.next( event );
+    if( ok ) fill( event, energy, next );
+
+    std::unique_lock<std::mutex> guard( lock );
+    if( !ok ) {
+      endoffile = true;
+      return;
+    }
+    wake.wait( guard, [this]() { return !havepending || stopping; } );
+    if( stopping ) return;
+    std::swap( pending, next );
+    havepending = true;
+  }
+}
+
+bool Replay::advance() {
+  // Show the prefetched event if there is one, never waits for the loader
+  {
+    std::lock_guard<std::mutex> guard( lock );
+    if( !havepending ) return false;
+    std::swap( current, pending );
+    havepending = false;
+  }
+  wake.notify_one();
+  shown++;
+
+  int nmodules = current.colors.size();
+  for( int i=0; i<nmodules; i++ ) {
+    sf::Vertex* quad = &heatmap[4*i];
+    quad[0].color = quad[1].color = quad[2].color = quad[3].color = current.colors[i];
+  }
+
+  // Fired patterns in yellow, the list is in pattern order
+  int f = 0;
+  for( int g=0; g<int(sumtext.size()); g++ ) {
+    bool fired = f < int(current.fired.size()) && current.fired[f] == g;
+    if( fired ) f++;
+    std::stringstream sum;
+    sum << int(current.sums[g]);
+    sumtext[g].setString( sum.str() );
+    sf::FloatRect box = sumtext[g].getLocalBounds();
+    sumtext[g].setOrigin( 0.5*box.width, 0.5*box.height );
+    sumtext[g].setColor( fired ? sf::Color::Yellow : sf::Color::White );
+  }
+
+  std::stringstream text;
+  text << "event " << current.id << "   E = " << int(current.total) << " MeV   fired " << current.fired.size();
+  status.setString( text.str() );
+  return true;
+}
+
+bool Replay::finished() {
+  std::lock_guard<std::mutex> guard( lock );
+  return endoffile && !havepending;
+}
+
+void Replay::draw(sf::RenderTarget& target, sf::RenderStates) const {
+  target.draw( heatmap );
+
+  // Fired patterns with their logic borders
+  const std::vector<std::vector<sf::VertexArray> >& borders = ecal->logicboarders();
+  for( int f=0; f<int(current.fired.size()); f++ ) {
+    int g = current.fired[f];
+    if( g >= int(borders.size()) ) continue;
+    for( int k=0; k<int(borders[g].size()); k++ ) {
+      target.draw( borders[g][k] );
+    }
+  }
+  for( int g=0; g<int(sumtext.size()); g++ ) {
+    target.draw( sumtext[g] );
+  }
+  target.draw( status );
+}
@@ -0,0 +1,51 @@
+#include "../include/ScratchArena.hh"
+#include <cstdlib>
+#include <new>
+
+ScratchArena::ScratchArena(size_t initial) {
+  capacity = initial > 64 ? initial : 64;
+  block = static_cast<char*>( malloc( capacity ) );
+  if( !block ) throw std::bad_alloc();
+  used = 0;
+  highwater = 0;
+  overflowbytes = 0;
+  heapblocks = 1;
+}
+
+ScratchArena::~ScratchArena() {
+  for( size_t i=0; i<overflow.size(); i++ ) free( overflow[i] );
+  free( block );
+}
+
+void* ScratchArena::allocate(size_t bytes, size_t align) {
+  size_t start = ( used + align - 1 ) & ~( align - 1 );
+  if( start + bytes <= capacity ) {
+    used = start + bytes;
+    if( used + overflowbytes > highwater ) highwater = used + overflowbytes;
+    return block + start;
+  }
+
+  // Handle running out: a separate block now, a bigger arena at reset()
+  char* extra = static_cast<char*>( malloc( bytes + align ) );
+  if( !extra ) throw std::bad_alloc();
+  overflow.push_back( extra );
+  overflowbytes += bytes + align;
+  heapblocks++;
+  if( used + overflowbytes > highwater ) highwater = used + overflowbytes;
+  size_t offset = ( align - reinterpret_cast<size_t>( extra ) % align ) % align;
+  return extra + offset;
+}
+
+void ScratchArena::reset() {
+  if( !overflow.empty() ) {
+    for( size_t i=0; i<overflow.size(); i++ ) free( overflow[i] );
+    overflow.clear();
+    overflowbytes = 0;
+    free( block );
+    capacity = highwater + highwater/4;
+    block = static_cast<char*>( malloc( capacity ) );
+    if( !block ) throw std::bad_alloc();
+    heapblocks++;
+  }
+  used = 0;
+}
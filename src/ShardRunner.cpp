@@ -0,0 +1,158 @@
+#include "../include/ShardRunner.hh"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <deque>
+#include <map>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+SharedSegment::~SharedSegment() {
+  if( base ) munmap( base, bytes );
+}
+
+bool SharedSegment::allocate(size_t size) {
+  if( base ) munmap( base, bytes );
+  bytes = size > 0 ? size : 1;
+  base = mmap( 0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+  if( base == MAP_FAILED ) {
+    std::cerr << "Error mapping " << bytes << " bytes of shared memory" << std::endl;
+    base = 0;
+    bytes = 0;
+    return false;
+  }
+  return true;
+}
+
+bool SharedSegment::seal() {
+  // A worker writing to the tables now faults instead of diverging
+  return base && mprotect( base, bytes, PROT_READ ) == 0;
+}
+
+ShardRunner::ShardRunner(const std::string& directory, int shards, int workers, int tries)
+  : dir( directory ), nshards( shards ), nworkers( workers ), maxattempts( tries ) {
+  if( nworkers < 1 ) nworkers = 1;
+  if( maxattempts < 1 ) maxattempts = 1;
+  attempts.assign( nshards, 0 );
+  mkdir( dir.c_str(), 0755 );
+}
+
+std::string ShardRunner::shardfile(int shard) const {
+  std::ostringstream name;
+  name << dir << "/shard_" << std::setw(5) << std::setfill('0') << shard << ".txt";
+  return name.str();
+}
+
+std::string ShardRunner::partfile(int shard) const {
+  std::string name = shardfile( shard );
+  return name.substr( 0, name.size() - 4 ) + ".part";
+}
+
+bool ShardRunner::manifest(const std::string& job) {
+  std::string name = dir + "/manifest.txt";
+  std::ifstream in( name.c_str() );
+  if( in ) {
+    std::ostringstream old;
+    old << in.rdbuf();
+    if( old.str() == job ) return true;
+    std::cerr << "Error: " << dir << " holds a different job, its manifest is" << std::endl
+	      << old.str() << "use a new directory or remove the old one" << std::endl;
+    return false;
+  }
+  if( remaining() < nshards ) {
+    std::cerr << "Error: " << dir << " has shards but no manifest, remove them first" << std::endl;
+    return false;
+  }
+
+  FILE* out = fopen( ( name + ".part" ).c_str(), "w" );
+  if( !out ) {
+    std::cerr << "Error opening " << name << std::endl;
+    return false;
+  }
+  bool good = fputs( job.c_str(), out ) >= 0;
+  good = fclose( out ) == 0 && good;
+  return good && rename( ( name + ".part" ).c_str(), name.c_str() ) == 0;
+}
+
+bool ShardRunner::done(int shard) const {
+  struct stat info;
+  return stat( shardfile( shard ).c_str(), &info ) == 0;
+}
+
+int ShardRunner::remaining() const {
+  int left = 0;
+  for( int s=0; s<nshards; s++ ) if( !done(s) ) left++;
+  return left;
+}
+
+bool ShardRunner::run(const Work& work) {
+  std::deque<int> queue;
+  for( int s=0; s<nshards; s++ ) if( !done(s) ) queue.push_back( s );
+
+  std::map<pid_t,int> running;
+  bool ok = true;
+  while( !queue.empty() || !running.empty() ) {
+    // Handle starting workers up to the limit
+    while( !queue.empty() && int(running.size()) < nworkers ) {
+      int shard = queue.front();
+      queue.pop_front();
+      attempts[shard]++;
+      std::cout.flush();
+      std::cerr.flush();
+      pid_t pid = fork();
+      if( pid < 0 ) {
+	std::cerr << "Error forking shard " << shard << std::endl;
+	queue.push_front( shard );
+	break;
+      }
+      if( pid == 0 ) {
+	FILE* out = fopen( partfile( shard ).c_str(), "w" );
+	bool good = out && work( shard, out );
+	good = out && fclose( out ) == 0 && good;
+	_exit( good ? 0 : 1 );
+      }
+      running[pid] = shard;
+    }
+    if( running.empty() ) {
+      ok = false;
+      break;
+    }
+
+    // Handle a finished worker, clean exits become checkpoints
+    int status;
+    pid_t pid = waitpid( -1, &status, 0 );
+    if( pid < 0 ) {
+      if( errno == EINTR ) continue;
+      ok = false;
+      break;
+    }
+    std::map<pid_t,int>::iterator it = running.find( pid );
+    if( it == running.end() ) continue;
+    int shard = it->second;
+    running.erase( it );
+
+    bool clean = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if( clean && rename( partfile( shard ).c_str(), shardfile( shard ).c_str() ) == 0 ) continue;
+
+    unlink( partfile( shard ).c_str() );
+    if( WIFSIGNALED(status) ) {
+      std::cerr << "Shard " << shard << " killed by signal " << WTERMSIG(status);
+    }
+    else {
+      std::cerr << "Shard " << shard << " failed";
+    }
+    if( attempts[shard] < maxattempts ) {
+      std::cerr << ", retrying" << std::endl;
+      queue.push_back( shard );
+    }
+    else {
+      std::cerr << ", giving up after " << attempts[shard] << " attempts" << std::endl;
+      ok = false;
+    }
+  }
+  return ok && remaining() == 0;
+}
@@ -0,0 +1,215 @@
+#include "../include/ShowerGenerator.hh"
+#include <cmath>
+
+namespace {
+  // splitmix64, used to spread a seed over the generator state
+  unsigned long long splitmix(unsigned long long& x) {
+    unsigned long long z = ( x += 0x9e3779b97f4a7c15ULL );
+    z = ( z ^ (z >> 30) ) * 0xbf58476d1ce4e5b9ULL;
+    z = ( z ^ (z >> 27) ) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+}
+
+ShowerRandom::ShowerRandom(unsigned long long seed, unsigned long long stream) {
+  // Every (seed, stream) pair gives its own set of lanes
+  unsigned long long x = seed ^ ( 0x632be59bd9b4e019ULL * (stream + 1) );
+  for( int l=0; l<LANES; l++ ) {
+    s0[l] = splitmix( x );
+    s1[l] = splitmix( x );
+    if( s0[l] == 0 && s1[l] == 0 ) s1[l] = 1;
+  }
+  used = LANES;
+  havespare = false;
+}
+
+void ShowerRandom::refill() {
+  unsigned long long out[LANES];
+  for( int l=0; l<LANES; l++ ) {
+    unsigned long long a = s0[l];
+    unsigned long long b = s1[l];
+    s0[l] = b;
+    a ^= a << 23;
+    s1[l] = a ^ b ^ (a >> 17) ^ (b >> 26);
+    out[l] = s1[l] + b;
+  }
+  // top 53 bits to a double in (0,1)
+  for( int l=0; l<LANES; l++ ) {
+    block[l] = ( (out[l] >> 11) + 0.5 ) * ( 1.0 / 9007199254740992.0 );
+  }
+  used = 0;
+}
+
+double ShowerRandom::gauss() {
+  // Box-Muller, the sine half is kept for the next call
+  if( havespare ) {
+    havespare = false;
+    return spare;
+  }
+  double u1 = uniform();
+  double u2 = uniform();
+  double r = sqrt( -2.0*log(u1) );
+  spare = r * sin( 2*M_PI*u2 );
+  havespare = true;
+  return r * cos( 2*M_PI*u2 );
+}
+
+ShowerGenerator::ShowerGenerator(const Layout& table, unsigned long long seed, unsigned long long stream)
+  : random( seed, stream ) {
+  layout = &table;
+  setresolution( 0.06, 0.01 );
+
+  minx = maxx = miny = maxy = 0;
+  for( int i=0; i<layout->size(); i++ ) {
+    const Module& mod = layout->module(i);
+    minx = (mod.x < minx) ? mod.x : minx;
+    maxx = (mod.x > maxx) ? mod.x : maxx;
+    miny = (mod.y < miny) ? mod.y : miny;
+    maxy = (mod.y > maxy) ? mod.y : maxy;
+  }
+  // Lead glass, Moliere radius about 37 mm
+  setprofile( 12.0, 40.0, 0.8 );
+}
+
+void ShowerGenerator::setresolution(double a, double b) {
+  stochastic = a;
+  constant = b;
+}
+
+void ShowerGenerator::setprofile(double corewidth, double halowidth, double fcore) {
+  core = corewidth;
+  halo = halowidth;
+  corefraction = fcore;
+  reach = 3*halo;
+
+  // Cumulative profiles along one axis, 0.25 mm steps out to reach plus
+  // the largest half module
+  tablestep = 0.25;
+  tablerange = reach + 2*21;
+  int nsteps = int( 2*tablerange / tablestep ) + 2;
+  corecdf.resize( nsteps );
+  halocdf.resize( nsteps );
+  for( int k=0; k<nsteps; k++ ) {
+    double u = -tablerange + k*tablestep;
+    corecdf[k] = 0.5 * ( 1 + erf( u / ( sqrt(2.0)*core ) ) );
+    halocdf[k] = 0.5 * ( 1 + erf( u / ( sqrt(2.0)*halo ) ) );
+  }
+
+  // Bin the modules that can receive energy from a shower in each bin
+  binsize = 20;
+  nbinx = int( (maxx - minx) / binsize ) + 1;
+  nbiny = int( (maxy - miny) / binsize ) + 1;
+  binstart.assign( nbinx*nbiny + 1, 0 );
+  binmodules.clear();
+  for( int by=0; by<nbiny; by++ ) {
+    for( int bx=0; bx<nbinx; bx++ ) {
+      binstart[ by*nbinx + bx ] = binmodules.size();
+      float cx = minx + (bx + 0.5)*binsize;
+      float cy = miny + (by + 0.5)*binsize;
+      for( int i=0; i<layout->size(); i++ ) {
+	const Module& mod = layout->module(i);
+	float cut = reach + 0.5*mod.type + binsize;
+	if( fabs( mod.x - cx ) < cut && fabs( mod.y - cy ) < cut ) binmodules.push_back( i );
+      }
+    }
+  }
+  binstart[ nbinx*nbiny ] = binmodules.size();
+}
+
+double ShowerGenerator::fraction(double dx, double dy, double half) const {
+  // Share of the profile inside a square of half width half, centred
+  // dx, dy away from the impact point. Each factor is a difference of
+  // the tabulated cumulative profile, interpolated linearly.
+  double u[4] = { dx+half, dx-half, dy+half, dy-half };
+  double c[4], h[4];
+  int last = corecdf.size() - 2;
+  for( int k=0; k<4; k++ ) {
+    double t = ( u[k] + tablerange ) / tablestep;
+    t = t < 0 ? 0 : ( t > last ? last : t );
+    int i = int(t);
+    double w = t - i;
+    c[k] = corecdf[i] + w * ( corecdf[i+1] - corecdf[i] );
+    h[k] = halocdf[i] + w * ( halocdf[i+1] - halocdf[i] );
+  }
+  return corefraction * (c[0]-c[1]) * (c[2]-c[3]) + (1-corefraction) * (h[0]-h[1]) * (h[2]-h[3]);
+}
+
+void ShowerGenerator::footprint(float x, float y, float energy, float* deposit) const {
+  for( int i=0; i<layout->size(); i++ ) deposit[i] = 0;
+  int bx = int( (x - minx) / binsize );
+  int by = int( (y - miny) / binsize );
+  bx = bx < 0 ? 0 : ( bx >= nbinx ? nbinx-1 : bx );
+  by = by < 0 ? 0 : ( by >= nbiny ? nbiny-1 : by );
+  int bin = by*nbinx + bx;
+  for( int k=binstart[bin]; k<binstart[bin+1]; k++ ) {
+    const Module& mod = layout->module( binmodules[k] );
+    deposit[ binmodules[k] ] = energy * fraction( mod.x - x, mod.y - y, 0.5*mod.type );
+  }
+}
+
+int ShowerGenerator::footprint(float x, float y, float energy, int* modules, float* deposit) const {
+  int bx = int( (x - minx) / binsize );
+  int by = int( (y - miny) / binsize );
+  bx = bx < 0 ? 0 : ( bx >= nbinx ? nbinx-1 : bx );
+  by = by < 0 ? 0 : ( by >= nbiny ? nbiny-1 : by );
+  int bin = by*nbinx + bx;
+  int n = 0;
+  for( int k=binstart[bin]; k<binstart[bin+1]; k++ ) {
+    const Module& mod = layout->module( binmodules[k] );
+    modules[n] = binmodules[k];
+    deposit[n] = energy * fraction( mod.x - x, mod.y - y, 0.5*mod.type );
+    n++;
+  }
+  return n;
+}
+
+int ShowerGenerator::maxfootprint() const {
+  int most = 0;
+  for( int b=0; b<nbinx*nbiny; b++ ) {
+    most = ( binstart[b+1] - binstart[b] > most ) ? binstart[b+1] - binstart[b] : most;
+  }
+  return most;
+}
+
+float ShowerGenerator::shower(float x, float y, float energy, float* deposit, Event* event) {
+  // energy in MeV. Each module fluctuates with its own stochastic term,
+  // so the sum has stochastic/sqrt(E) on top of the common constant term.
+  int bx = int( (x - minx) / binsize );
+  int by = int( (y - miny) / binsize );
+  bx = bx < 0 ? 0 : ( bx >= nbinx ? nbinx-1 : bx );
+  by = by < 0 ? 0 : ( by >= nbiny ? nbiny-1 : by );
+  int bin = by*nbinx + bx;
+  double scale = 1 + constant * random.gauss();
+  float total = 0;
+  if( event ) event->clear();
+  for( int k=binstart[bin]; k<binstart[bin+1]; k++ ) {
+    int i = binmodules[k];
+    const Module& mod = layout->module(i);
+    double e = energy * fraction( mod.x - x, mod.y - y, 0.5*mod.type );
+    if( e < 0.1 ) continue;
+    e *= scale;
+    e += stochastic * sqrt( e * 1000.0 ) * random.gauss();
+    if( e <= 0 ) continue;
+    if( deposit ) deposit[i] += e;
+    if( event ) event->add( mod.cell, e );
+    total += e;
+  }
+  return total;
+}
+
+void ShowerGenerator::randompoint(float& x, float& y) {
+  // Uniform over the bounding box, kept if it lands on a module
+  while( true ) {
+    x = minx + ( maxx - minx ) * random.uniform();
+    y = miny + ( maxy - miny ) * random.uniform();
+    int bx = int( (x - minx) / binsize );
+    int by = int( (y - miny) / binsize );
+    bx = bx >= nbinx ? nbinx-1 : bx;
+    by = by >= nbiny ? nbiny-1 : by;
+    int bin = by*nbinx + bx;
+    for( int k=binstart[bin]; k<binstart[bin+1]; k++ ) {
+      const Module& mod = layout->module( binmodules[k] );
+      if( fabs( mod.x - x ) < 0.5*mod.type && fabs( mod.y - y ) < 0.5*mod.type ) return;
+    }
+  }
+}
@@ -0,0 +1,179 @@
+#include "../include/StreamRate.hh"
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+
+namespace {
+  // Ring slot of a slice, also for negative times
+  inline int slot(long slice, int n) {
+    long k = slice % n;
+    return ( k < 0 ) ? k + n : k;
+  }
+}
+
+StreamRate::StreamRate(const LogicTable& table, const LogicParams& params, double width, int slices) {
+  logic = &table;
+  slicewidth = width;
+  nslices = (slices > 0) ? slices : 1;
+  ngroups = logic->groups();
+
+  // Invert the pattern -> cells table
+  int maxcell = 0;
+  for( int g=0; g<ngroups; g++ ) {
+    int n;
+    const int* cells = logic->group( g, n );
+    for( int k=0; k<n; k++ ) maxcell = (cells[k] > maxcell) ? cells[k] : maxcell;
+  }
+  cellstart.assign( maxcell+2, 0 );
+  for( int g=0; g<ngroups; g++ ) {
+    int n;
+    const int* cells = logic->group( g, n );
+    for( int k=0; k<n; k++ ) cellstart[ cells[k]+1 ]++;
+  }
+  for( int c=0; c<=maxcell; c++ ) cellstart[c+1] += cellstart[c];
+  cellgroups.resize( cellstart.back() );
+  std::vector<int> fill( cellstart.begin(), cellstart.end()-1 );
+  for( int g=0; g<ngroups; g++ ) {
+    int n;
+    const int* cells = logic->group( g, n );
+    for( int k=0; k<n; k++ ) cellgroups[ fill[cells[k]]++ ] = g;
+  }
+
+  threshold.resize( ngroups );
+  for( int g=0; g<ngroups; g++ ) {
+    threshold[g] = ( g < params.size() ) ? params.cut(g) : 0;
+  }
+  monitor = 0;
+  interval = 0;
+  reset();
+}
+
+void StreamRate::reset() {
+  ring.assign( long(ngroups)*nslices, 0 );
+  windowsum.assign( ngroups, 0 );
+  // Set from the first hit, times may start anywhere
+  lastslice.assign( ngroups, 0 );
+  above.assign( ngroups, 0 );
+  triggers.assign( ngroups, 0 );
+  accidentals.assign( ngroups, 0 );
+  pileups.assign( ngroups, 0 );
+  nhits = 0;
+  nlate = 0;
+  newest = 0;
+  firsttime = 0;
+  lasttime = 0;
+  nextemit = 0;
+  ntriggers = naccidentals = 0;
+  emittedhits = emittedtriggers = emittedaccidentals = 0;
+}
+
+void StreamRate::online(std::ostream& out, double ns) {
+  monitor = ( ns > 0 ) ? &out : 0;
+  interval = ns;
+  nextemit = ( nhits > 0 ) ? lasttime + interval : 0;
+}
+
+void StreamRate::emit(double time) {
+  // One line per interval with hits: end of the interval (ns), triggers
+  // and accidentals in it and their rates in Hz
+  if( nhits == emittedhits ) return;
+  double seconds = interval * 1e-9;
+  long t = ntriggers - emittedtriggers;
+  long a = naccidentals - emittedaccidentals;
+  *monitor << "# t = " << time << " ns, hits = " << nhits << ", triggers = " << t
+	   << " (" << t / seconds << " Hz), accidental = " << a
+	   << " (" << a / seconds << " Hz)" << std::endl;
+  emittedhits = nhits;
+  emittedtriggers = ntriggers;
+  emittedaccidentals = naccidentals;
+}
+
+void StreamRate::advance(int g, long slice) {
+  // Expire the slices that fall out of the window when moving to slice
+  float* r = &ring[ long(g)*nslices ];
+  long steps = slice - lastslice[g];
+  if( steps <= 0 ) return;
+  if( steps >= nslices ) {
+    for( int k=0; k<nslices; k++ ) r[k] = 0;
+    windowsum[g] = 0;
+  }
+  else {
+    for( long s=lastslice[g]+1; s<=slice; s++ ) {
+      windowsum[g] -= r[ slot(s, nslices) ];
+      r[ slot(s, nslices) ] = 0;
+    }
+  }
+  lastslice[g] = slice;
+  if( windowsum[g] <= threshold[g] ) above[g] = 0;
+}
+
+void StreamRate::addhit(int cell, float energy, double time) {
+  long slice = long( floor( time / slicewidth ) );
+  if( nhits == 0 ) {
+    firsttime = lasttime = time;
+    newest = slice;
+    lastslice.assign( ngroups, slice );
+    if( monitor ) nextemit = time + interval;
+  }
+  // Emit before counting a hit beyond the interval, so each line only
+  // covers its own interval. After a gap the intervals in between had no
+  // hits, so there is one line at most and the next end is the one of
+  // the interval holding this hit.
+  if( monitor && time >= nextemit ) {
+    emit( nextemit );
+    nextemit += interval * ( floor( ( time - nextemit ) / interval ) + 1 );
+  }
+  lasttime = (time > lasttime) ? time : lasttime;
+  nhits++;
+
+  // Hits that arrive out of order still count while inside the window.
+  // No pattern has moved past the newest slice, so a hit inside the
+  // window of the newest slice is inside the window of every pattern.
+  if( slice <= newest - nslices ) {
+    nlate++;
+    return;
+  }
+  newest = (slice > newest) ? slice : newest;
+  if( cell < 0 || cell+1 >= int(cellstart.size()) ) return;
+
+  for( int k=cellstart[cell]; k<cellstart[cell+1]; k++ ) {
+    int g = cellgroups[k];
+    advance( g, slice );
+
+    float* r = &ring[ long(g)*nslices ];
+    r[ slot(slice, nslices) ] += energy;
+    windowsum[g] += energy;
+
+    if( !above[g] && windowsum[g] > threshold[g] ) {
+      above[g] = 1;
+      triggers[g]++;
+      ntriggers++;
+      float largest = 0;
+      int filled = 0;
+      for( int s=0; s<nslices; s++ ) {
+	largest = (r[s] > largest) ? r[s] : largest;
+	if( r[s] > 0 ) filled++;
+      }
+      if( largest <= threshold[g] ) {
+	accidentals[g]++;
+	naccidentals++;
+      }
+      if( filled > 1 ) pileups[g]++;
+    }
+  }
+}
+
+void StreamRate::report(std::ostream& out) const {
+  // Times are in ns, rates in Hz
+  double seconds = elapsed() * 1e-9;
+  out << "# hits = " << nhits << ", late = " << nlate << ", live time = " << seconds << " s" << std::endl;
+  out << "# window = " << nslices << " x " << slicewidth << " ns" << std::endl;
+  out << std::setw(6) << "#group" << std::setw(10) << "triggers" << std::setw(12) << "rate"
+      << std::setw(12) << "accidental" << std::setw(12) << "acc. rate" << std::setw(10) << "pileup" << std::endl;
+  for( int g=0; g<ngroups; g++ ) {
+    double rate = ( seconds > 0 ) ? triggers[g] / seconds : 0;
+    double accrate = ( seconds > 0 ) ? accidentals[g] / seconds : 0;
+    out << std::setw(6) << g+1 << std::setw(10) << triggers[g] << std::setw(12) << rate
+	<< std::setw(12) << accidentals[g] << std::setw(12) << accrate << std::setw(10) << pileups[g] << std::endl;
+  }
+}
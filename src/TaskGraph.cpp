@@ -0,0 +1,90 @@
+#include "../include/TaskGraph.hh"
+
+#include <iostream>
+
+int TaskGraph::add(const std::string& name, const std::function<void()>& work,
+		   const std::vector<int>& after) {
+  int id = tasks.size();
+  Task task;
+  task.name = name;
+  task.work = work;
+  task.started = false;
+  task.finished = false;
+  for( int i=0; i<(int)after.size(); i++ ) {
+    // Only earlier tasks, so the graph can not have cycles
+    if( after[i] < 0 || after[i] >= id ) {
+      std::cerr << "Task " << name << " depends on unknown task " << after[i] << std::endl;
+      continue;
+    }
+    task.after.push_back( after[i] );
+  }
+  tasks.push_back( task );
+  return id;
+}
+
+bool TaskGraph::runnable(int t) const {
+  if( tasks[t].started ) return false;
+  for( int i=0; i<(int)tasks[t].after.size(); i++ ) {
+    if( !tasks[ tasks[t].after[i] ].finished ) return false;
+  }
+  return true;
+}
+
+void TaskGraph::work() {
+  std::unique_lock<std::mutex> guard( lock );
+  while( nstarted < (int)tasks.size() ) {
+    int next = -1;
+    for( int t=0; t<(int)tasks.size() && next < 0; t++ ) {
+      if( runnable(t) ) next = t;
+    }
+    // Everything left waits on a running task
+    if( next < 0 ) {
+      changed.wait( guard );
+      continue;
+    }
+    tasks[next].started = true;
+    nstarted++;
+
+    guard.unlock();
+    tasks[next].work();
+    guard.lock();
+
+    tasks[next].finished = true;
+    nfinished++;
+    reported.push_back( next );
+    changed.notify_all();
+  }
+}
+
+void TaskGraph::start(int nworkers) {
+  if( nworkers > (int)tasks.size() ) nworkers = tasks.size();
+  if( nworkers < 1 ) nworkers = 1;
+  for( int w=0; w<nworkers; w++ ) {
+    workers.push_back( std::thread( &TaskGraph::work, this ) );
+  }
+}
+
+bool TaskGraph::poll(int& task) {
+  std::lock_guard<std::mutex> guard( lock );
+  if( reported.empty() ) return false;
+  task = reported.front();
+  reported.pop_front();
+  return true;
+}
+
+bool TaskGraph::done(int task) const {
+  std::lock_guard<std::mutex> guard( lock );
+  return task >= 0 && task < (int)tasks.size() && tasks[task].finished;
+}
+
+bool TaskGraph::finished() const {
+  std::lock_guard<std::mutex> guard( lock );
+  return nfinished == (int)tasks.size();
+}
+
+void TaskGraph::wait() {
+  for( int w=0; w<(int)workers.size(); w++ ) {
+    if( workers[w].joinable() ) workers[w].join();
+  }
+  workers.clear();
+}
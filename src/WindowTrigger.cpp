@@ -0,0 +1,147 @@
+#include "../include/WindowTrigger.hh"
+#include <cmath>
+#include <iostream>
+
+WindowTrigger::WindowTrigger(const Layout& geometry, int width, int height, int minmodules) {
+  layout = &geometry;
+  wrows = height;
+  wcols = 2*width;
+
+  // Half-module steps from x = 0, shifted by the same amount for every
+  // size band so the bands stay centred on each other. The module size
+  // of every row marks the bands.
+  nrows = layout->rows();
+  ncols = 0;
+  std::vector<int> column( layout->size() );
+  std::vector<int> rowtype( nrows, 0 );
+  int first = 0;
+  for( int i=0; i<layout->size(); i++ ) {
+    const Module& mod = layout->module(i);
+    column[i] = int( floor( mod.x / ( 0.5*mod.type ) + 0.5 ) );
+    if( i == 0 || column[i] < first ) first = column[i];
+    rowtype[ mod.row - 1 ] = mod.type;
+  }
+  for( int i=0; i<layout->size(); i++ ) {
+    column[i] -= first;
+    if( column[i] + 1 > ncols ) ncols = column[i] + 1;
+  }
+
+  grid.assign( nrows*ncols, 0 );
+  gridindex.resize( layout->size() );
+  std::vector<int> owner( nrows*ncols, -1 );
+  for( int i=0; i<layout->size(); i++ ) {
+    gridindex[i] = ( layout->module(i).row - 1 ) * ncols + column[i];
+    if( owner[ gridindex[i] ] >= 0 ) {
+      std::cerr << "Cells " << layout->module( owner[ gridindex[i] ] ).cell << " and "
+		<< layout->module(i).cell << " share a window grid cell" << std::endl;
+    }
+    owner[ gridindex[i] ] = i;
+  }
+
+  table.assign( (nrows+1)*(ncols+1), 0 );
+  nwinrows = nrows - wrows + 1 > 0 ? nrows - wrows + 1 : 0;
+  nwincols = ncols - wcols + 1 > 0 ? ncols - wcols + 1 : 0;
+  sums.assign( nwinrows*nwincols, 0 );
+
+  // Handle the live windows and their centres from the occupancy
+  live.assign( nwinrows*nwincols, 0 );
+  straddle.assign( nwinrows*nwincols, 0 );
+  centerx.assign( nwinrows*nwincols, 0 );
+  centery.assign( nwinrows*nwincols, 0 );
+  nlive = nstraddling = 0;
+  for( int r=0; r<nwinrows; r++ ) {
+    bool mixed = false;
+    int type = 0;
+    for( int rr=r; rr<r+wrows; rr++ ) {
+      if( rowtype[rr] == 0 ) continue;
+      if( type != 0 && rowtype[rr] != type ) mixed = true;
+      type = rowtype[rr];
+    }
+    for( int c=0; c<nwincols; c++ ) {
+      int w = r*nwincols + c;
+      int n = 0;
+      for( int rr=r; rr<r+wrows; rr++ ) {
+	for( int cc=c; cc<c+wcols; cc++ ) {
+	  int i = owner[ rr*ncols + cc ];
+	  if( i < 0 ) continue;
+	  centerx[w] += layout->module(i).x;
+	  centery[w] += layout->module(i).y;
+	  n++;
+	}
+      }
+      if( n > 0 ) {
+	centerx[w] /= n;
+	centery[w] /= n;
+      }
+      if( n >= minmodules && mixed ) {
+	straddle[w] = 1;
+	nstraddling++;
+      }
+      else if( n >= minmodules ) {
+	live[w] = 1;
+	nlive++;
+      }
+    }
+  }
+}
+
+void WindowTrigger::process(const float* energy) {
+  // Cells without a module stay at zero
+  int nmod = layout->size();
+  for( int i=0; i<nmod; i++ ) grid[ gridindex[i] ] = energy[i];
+
+  // Summed-area table: running sums along every row first, then add
+  // each row to the one above it, which runs across columns
+  int stride = ncols + 1;
+  for( int r=0; r<nrows; r++ ) {
+    const float* g = &grid[0] + r*ncols;
+    float* t = &table[0] + (r+1)*stride;
+    float run = 0;
+    for( int c=0; c<ncols; c++ ) {
+      run += g[c];
+      t[c+1] = run;
+    }
+  }
+  for( int r=1; r<nrows; r++ ) {
+    const float* above = &table[0] + r*stride;
+    float* t = &table[0] + (r+1)*stride;
+    for( int c=1; c<=ncols; c++ ) t[c] += above[c];
+  }
+
+  // Every window from its four corners
+  for( int r=0; r<nwinrows; r++ ) {
+    const float* top = &table[0] + r*stride;
+    const float* bottom = &table[0] + (r+wrows)*stride;
+    float* s = &sums[0] + r*nwincols;
+    for( int c=0; c<nwincols; c++ ) {
+      s[c] = bottom[c+wcols] - top[c+wcols] - bottom[c] + top[c];
+    }
+  }
+}
+
+int WindowTrigger::passthreshold(float cut, int* straddling) const {
+  int n = windows();
+  const float* s = &sums[0];
+  const float* l = &live[0];
+  const float* m = &straddle[0];
+  int nfired = 0, nstraddle = 0;
+  for( int w=0; w<n; w++ ) {
+    int over = s[w] > cut;
+    nfired += over * int( l[w] );
+    nstraddle += over * int( m[w] );
+  }
+  if( straddling ) *straddling = nstraddle;
+  return nfired;
+}
+
+int WindowTrigger::maxwindow() const {
+  int best = -1;
+  float value = 0;
+  for( int w=0; w<windows(); w++ ) {
+    if( live[w] > 0 && ( best < 0 || sums[w] > value ) ) {
+      best = w;
+      value = sums[w];
+    }
+  }
+  return best;
+}
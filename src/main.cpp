@@ -6,75 +6,179 @@
 #include <SFML/Graphics.hpp>
 #include <SFML/System.hpp>
 #include <iostream>
+#include <string>
+#include <cstdlib>
 
 #include "../include/ECal.hh"
+#include "../include/Replay.hh"
+#include "../include/Profiler.hh"
 
 const float gDisplayx = 1900;
 const float gDisplayy = 5000;
-int main() {
+
+// Window and camera events shared by the viewer and the replay.
+// Returns true if the picture has to be redrawn.
+bool handlewindow(sf::RenderWindow& window, sf::View& view, const sf::Event& event) {
+  if( event.type == sf::Event::Closed ) {
+    window.close();
+  }
+  if( event.type == sf::Event::KeyPressed ) {
+    switch( event.key.code ) {
+    case sf::Keyboard::Escape : window.close();
+      return false;
+    // UPDATING CAMERA, arrow keys repeat while held
+    case sf::Keyboard::Up : view.move( 0, 10 );
+      return true;
+    case sf::Keyboard::Down : view.move( 0, -10 );
+      return true;
+    case sf::Keyboard::Left : view.move( 10, 0 );
+      return true;
+    case sf::Keyboard::Right : view.move( -10, 0 );
+      return true;
+    default :
+      return false;
+    }
+  }
+  if( event.type == sf::Event::MouseButtonPressed ) {
+    if( event.mouseButton.button == sf::Mouse::Left ) view.zoom( 0.8 );
+    if( event.mouseButton.button == sf::Mouse::Right ) view.zoom( 1.25 );
+    return true;
+  }
+  if( event.type == sf::Event::MouseWheelMoved ) {
+    view.zoom( event.mouseWheel.delta > 0 ? 0.9 : 1.1 );
+    return true;
+  }
+  // The window contents may have been lost
+  if( event.type == sf::Event::Resized || event.type == sf::Event::GainedFocus ) {
+    return true;
+  }
+  return false;
+}
+
+// Play back an event file on top of the geometry. Space pauses, N steps
+// one event while paused, Page Up/Down double or halve the rate.
+int replay(sf::RenderWindow& window, sf::View& view, ECal& ecal, int argc, char** argv) {
+  float threshold = (argc > 3) ? atof(argv[3]) : 1000;
+  float emax = (argc > 4) ? atof(argv[4]) : 1000;
+  std::string paramfile = (argc > 5) ? argv[5] : "param_dontdelete.txt";
+  std::string paramlogic = (argc > 6) ? argv[6] : "full_logic_sept25.txt";
+  Replay replay( ecal, emax, threshold, paramfile, paramlogic );
+  if( !replay.open( argv[2] ) ) return 1;
+
+  window.setFramerateLimit( 0 );
+  float rate = 100;   // events per second
+  bool playing = true;
+  bool redraw = true;
+  sf::Clock clock;
+  while( window.isOpen() ) {
+    sf::Event event;
+    while( window.pollEvent(event) ) {
+      if( handlewindow( window, view, event ) ) redraw = true;
+      if( event.type == sf::Event::KeyPressed ) {
+	if( event.key.code == sf::Keyboard::Space ) playing = !playing;
+	if( event.key.code == sf::Keyboard::N && !playing && replay.advance() ) redraw = true;
+	if( event.key.code == sf::Keyboard::PageUp ) rate *= 2;
+	if( event.key.code == sf::Keyboard::PageDown && rate > 1 ) rate /= 2;
+      }
+    }
+
+    if( playing && clock.getElapsedTime().asSeconds() >= 1.0/rate && replay.advance() ) {
+      clock.restart();
+      redraw = true;
+    }
+    if( replay.finished() ) playing = false;
+
+    if( redraw ) {
+      window.clear(sf::Color::Black);
+      window.setView( view );
+      window.draw(replay);
+      window.display();
+      redraw = false;
+    }
+    else {
+      sf::sleep( sf::milliseconds(1) );
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
   //GAME SETUP
   sf::RenderWindow window(sf::VideoMode(gDisplayx,gDisplayy), "ECAL Model");
   window.setFramerateLimit(60);
 
-  // Handling Time 
-  sf::Clock clock;
-  float time;
-  
   // Handling Camera View
   sf::View view(sf::FloatRect(0.5*gDisplayx, 0.5*gDisplayy, gDisplayx, 1200) );
   view.setCenter( 0.5*gDisplayx, 500 );
-  int mouseDelta = 0;
 
-  // INITIALIZE ECAL
+  // Profile the start up as well when ECAL_PROFILE is set, P toggles it later
+  if( getenv("ECAL_PROFILE") ) {
+    Profiler::enable( true );
+  }
+
+  // INITIALIZE ECAL: the modules are drawn right away, the logic,
+  // borders and labels appear as their start up tasks finish
   ECal ecal( window.getSize().x, window.getSize().y );
   ecal.initializeECal();
-  ecal.triggerlogic();
-  ecal.colorthelogic();
-  ecal.logicboarder();
-  ecal.indexnodes();
-  ecal.logicinfo();
+  ecal.startup();
   //ecal.specs();
 
+  // REPLAY MODE: ecal replay <event file> [threshold MeV] [colour scale MeV]
+  //                          [parameter file] [logic file of the parameters]
+  if( argc > 2 && std::string(argv[1]) == "replay" ) {
+    ecal.finish();
+    return replay( window, view, ecal, argc, argv );
+  }
+
+  // Only redraw when something changed. waitEvent() sleeps until the
+  // next input, so an idle viewer uses no CPU. While loading, poll
+  // instead so finished layers show up without input.
+  bool redraw = true;
   while( window.isOpen() ) {
-    sf::Event event;
-    while( window.pollEvent(event) ) {
-      if( event.type == sf::Event::Closed || sf::Keyboard::isKeyPressed(sf::Keyboard::Escape) ) {
-	window.close();
-      }
-    }
-    if( !ecal.onoroff() ) 
-      window.clear(sf::Color(220,220,220));
-    else
-      window.clear(sf::Color::Black);
-    
-    window.setView( view );
+    if( ecal.update() ) redraw = true;
+    if( redraw ) {
+      if( !ecal.onoroff() ) 
+	window.clear(sf::Color(220,220,220));
+      else
+	window.clear(sf::Color::Black);
+      window.setView( view );
 
-    // UPDATING
-    sf::Time elapsed = clock.restart();
-    ecal.controldrawings(elapsed);
-    // UPDATING CAMERA
-    if( sf::Mouse::isButtonPressed(sf::Mouse::Left) ) {
-      view.zoom( 0.95 );
-    }
-    if( sf::Mouse::isButtonPressed(sf::Mouse::Right) ) {
-      view.zoom( 1.05 );
-    }
-    if( sf::Keyboard::isKeyPressed(sf::Keyboard::Up) ) {
-      view.move( 0, 10 );
+      // DRAWINGS
+      window.draw(ecal);      
+      window.display();   
+      redraw = false;
     }
-    if( sf::Keyboard::isKeyPressed(sf::Keyboard::Down)) {
-      view.move( 0, -10 );
-    }
-    if( sf::Keyboard::isKeyPressed(sf::Keyboard::Left) ) {
-      view.move( 10, 0 );
-    }
-    if( sf::Keyboard::isKeyPressed(sf::Keyboard::Right) ) {
-      view.move( -10, -0 );
+
+    sf::Event event;
+    if( ecal.loading() ) {
+      if( !window.pollEvent(event) ) {
+	sf::sleep( sf::milliseconds(10) );
+	continue;
+      }
     }
-    
-    // DRAWINGS
-    window.draw(ecal);      
-    window.display();   
+    else if( !window.waitEvent(event) ) break;
+    do {
+      // EDITING: Shift + click toggles a node, Ctrl + click a module
+      if( event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left ) {
+	bool shift = sf::Keyboard::isKeyPressed( sf::Keyboard::LShift ) || sf::Keyboard::isKeyPressed( sf::Keyboard::RShift );
+	bool control = sf::Keyboard::isKeyPressed( sf::Keyboard::LControl ) || sf::Keyboard::isKeyPressed( sf::Keyboard::RControl );
+	if( shift || control ) {
+	  sf::Vector2i pixel( event.mouseButton.x, event.mouseButton.y );
+	  if( ecal.handleclick( window.mapPixelToCoords( pixel, view ), shift ) ) redraw = true;
+	  continue;
+	}
+      }
+      if( handlewindow( window, view, event ) ) redraw = true;
+      // UPDATING
+      if( event.type == sf::Event::KeyPressed && ecal.handlekey( event.key.code ) ) {
+	redraw = true;
+      }
+    } while( window.pollEvent(event) );
+  }
+  ecal.finish();
+  if( Profiler::on() ) {
+    Profiler::writetrace( "ecal_trace.json" );
+    Profiler::summary( std::cout );
   }
   return 0;
 }
@@ -0,0 +1,60 @@
+// Streaming trigger rate and pileup estimate for a time-ordered hit list.
+//
+// usage: stream_rate <hits|-> [logic file] [parameter file] [slice ns] [slices] [report ms]
+//
+// Hit lines are "time(ns) cell energy(MeV)", lines starting with '#' are
+// skipped. The whole run is processed in one pass with fixed memory.
+// While reading, the trigger rate of every report interval of hit time
+// (default 1 ms, 0 for none) goes to stderr; the per-pattern table is
+// printed at the end.
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "include/LogicTable.hh"
+#include "include/LogicParams.hh"
+#include "include/StreamRate.hh"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  if( argc < 2 ) {
+    cerr << "usage: stream_rate <hits|-> [logic file] [parameter file] [slice ns] [slices] [report ms]" << endl;
+    return 1;
+  }
+  string hitfile = argv[1];
+  string logicfile = (argc > 2) ? argv[2] : "full_logic_sept25.txt";
+  string paramfile = (argc > 3) ? argv[3] : "param_dontdelete.txt";
+  double slicewidth = (argc > 4) ? atof(argv[4]) : 4.0;
+  int nslices = (argc > 5) ? atoi(argv[5]) : 5;
+  double reportms = (argc > 6) ? atof(argv[6]) : 1.0;
+
+  LogicTable logic;
+  LogicParams params;
+  if( !logic.read( logicfile ) ) return 1;
+  if( !params.read( paramfile, logic.groups() ) ) return 1;
+
+  FILE* in = ( hitfile == "-" ) ? stdin : fopen( hitfile.c_str(), "r" );
+  if( !in ) {
+    cerr << "Error opening " << hitfile << endl;
+    return 1;
+  }
+
+  StreamRate rate( logic, params, slicewidth, nslices );
+  rate.online( cerr, 1e6 * reportms );
+  char line[256];
+  while( fgets( line, sizeof(line), in ) ) {
+    if( line[0] == '#' ) continue;
+    double time;
+    int cell;
+    float energy;
+    if( sscanf( line, "%lf %d %f", &time, &cell, &energy ) == 3 ) {
+      rate.addhit( cell, energy, time );
+    }
+  }
+  if( in != stdin ) fclose( in );
+
+  rate.report( cout );
+  return 0;
+}
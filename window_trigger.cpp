@@ -0,0 +1,103 @@
+// Fixed logic patterns against every 4 x 8 window, on the same showers.
+//
+// usage: window_trigger [nevents] [energy GeV] [window threshold MeV] [seed]
+//
+// Showers land uniformly on the detector (see ShowerGenerator). The
+// patterns use their thresholds from param_dontdelete.txt, the windows
+// one common threshold, by default the mean of the pattern thresholds.
+// Prints the trigger efficiency and the time per event of both. Windows
+// spanning two module size bands are not aligned module for module, so
+// the window line only counts windows within one band and is not the
+// efficiency of every window position. The spanning windows get a line
+// of their own, and the last line combines both.
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <chrono>
+
+#include "include/Layout.hh"
+#include "include/LogicTable.hh"
+#include "include/LogicParams.hh"
+#include "include/ShowerGenerator.hh"
+#include "include/WindowTrigger.hh"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+  int nevents = (argc > 1) ? atoi(argv[1]) : 20000;
+  float energy = 1000 * ( (argc > 2) ? atof(argv[2]) : 3.0 );
+  unsigned long long seed = (argc > 4) ? atoll(argv[4]) : 1;
+
+  Layout layout;
+  LogicTable logic;
+  LogicParams params;
+  if( !layout.read( "ecal_layout.txt" ) ) return 1;
+  if( !logic.read( "full_logic_sept25.txt" ) || !logic.bind( layout ) ) return 1;
+  if( !params.read( "param_dontdelete.txt", logic.groups() ) ) return 1;
+
+  // Unfitted patterns never fire and have no threshold to average
+  float cut = 0;
+  int nfitted = 0;
+  for( int g=0; g<params.size(); g++ ) {
+    if( params.fitted(g) ) {
+      cut += params.cut(g);
+      nfitted++;
+    }
+  }
+  if( nfitted > 0 ) cut /= nfitted;
+  if( argc > 3 ) cut = atof(argv[3]);
+
+  WindowTrigger windows( layout );
+  cout << windows.livewindows() << " live windows and " << windows.straddlingwindows()
+       << " spanning size bands of " << windows.windows() << " positions, "
+       << logic.groups() << " patterns, window threshold " << cut << " MeV" << endl;
+
+  // Showers first, so both triggers are timed on the same dense energies
+  ShowerGenerator generator( layout, seed );
+  int nmod = layout.size();
+  vector<float> energies( long(nevents) * nmod, 0 );
+  for( int ev=0; ev<nevents; ev++ ) {
+    float x, y;
+    generator.randompoint( x, y );
+    generator.shower( x, y, energy, &energies[0] + long(ev)*nmod, 0 );
+  }
+
+  vector<float> sums( logic.groups() );
+  vector<unsigned char> fired( logic.groups() );
+  long groupevents = 0, groupfired = 0;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for( int ev=0; ev<nevents; ev++ ) {
+    logic.groupsums( &energies[0] + long(ev)*nmod, &sums[0] );
+    int n = params.passthreshold( &sums[0], 1, &fired[0] );
+    groupfired += n;
+    groupevents += ( n > 0 );
+  }
+  double grouptime = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+  long windowevents = 0, windowfired = 0, straddleevents = 0, straddlefired = 0, onlystraddle = 0;
+  start = chrono::steady_clock::now();
+  for( int ev=0; ev<nevents; ev++ ) {
+    windows.process( &energies[0] + long(ev)*nmod );
+    int m;
+    int n = windows.passthreshold( cut, &m );
+    windowfired += n;
+    windowevents += ( n > 0 );
+    straddlefired += m;
+    straddleevents += ( m > 0 );
+    onlystraddle += ( n == 0 && m > 0 );
+  }
+  double windowtime = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+
+  cout << "patterns: efficiency " << double(groupevents) / nevents << ", "
+       << double(groupfired) / nevents << " fired per event, "
+       << 1e6 * grouptime / nevents << " us per event" << endl;
+  cout << "windows within one size band:  efficiency " << double(windowevents) / nevents << ", "
+       << double(windowfired) / nevents << " fired per event, "
+       << 1e6 * windowtime / nevents << " us per event for all windows" << endl;
+  cout << "windows spanning size bands:   efficiency " << double(straddleevents) / nevents << ", "
+       << double(straddlefired) / nevents << " fired per event, "
+       << double(onlystraddle) / nevents << " of the events only there" << endl;
+  cout << "all windows:                   efficiency " << double(windowevents + onlystraddle) / nevents << ", "
+       << double(windowfired + straddlefired) / nevents << " fired per event" << endl;
+  return 0;
+}